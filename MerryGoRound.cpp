@@ -24,7 +24,7 @@
 *   although 'w' and 's' while looking up/down works too (but not as accurate at certain degrees)
 * )
 *
-* Manual examine mode allows the user to rotate the object and zoom in/out
+* Manual examine mode allows the user to rotate the object and zoom in/out, clicking an object selects it
 *
 * Switching from Automatic to Manual free leaves the camera position mostly intact (may have to rotate around the y-axis afterwards to look at models again)
 * switching from Manual to Automatic resets the position to its initial value.
@@ -58,6 +58,7 @@
 *
 *** Manual Examine Mode only:
 * mouse click + drag mouse -> rotation similar to the way it is in Blender
+* mouse click without dragging -> select the object under the mouse
 * scroll wheel up/down -> zoom in/zoom out
 *
 *
@@ -73,6 +74,14 @@
 * n -> enable/disable diffuse rendering
 * m -> enable/disable specular rendering
 *
+*** Profiling:
+* f -> write the frame statistics (min/avg/p99 per pass) to profile.txt
+*
+*** Particles:
+* k -> switch between the particle simulation running one frame ahead and synchronous updates
+* g -> switch between simulating the particles on the GPU and on the CPU
+* h -> turn the repulsion between neighboring particles on/off (CPU simulation only)
+*
 */
 /******************** ADDITIONAL NOTES **************************
 *
@@ -85,6 +94,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include <math.h>
 #include <jpeglib.h> /* Include for billboard graphics */
 #include <jerror.h>
@@ -113,8 +123,15 @@ using namespace glm;
 #include "LoadShader.hpp"     /* Loading function for shader code */
 #include "Matrix.hpp"         /* Functions for matrix handling */
 #include "OBJParser.hpp"      /* Loading function for triangle meshes in OBJ format */
+#include "MeshCache.hpp"      /* Binary cache of parsed meshes */
 #include "Bezier.hpp"         /* Functions for bezier curve computations */
 #include "ColorConversion.hpp"/* Function for color space transformations */
+#include "ThreadPool.hpp"     /* Worker threads for loading */
+#include "RenderQueue.hpp"    /* Sorting of the draw calls by render state */
+#include "Frustum.hpp"        /* View frustum culling */
+#include "BVH.hpp"            /* Hierarchy over the scene objects for culling and picking */
+#include "Profiler.hpp"       /* CPU and GPU timing of the frame passes */
+#include "Particles.hpp"      /* SIMD particle update kernels */
 
 #ifndef M_PI
   #define M_PI 3.14159265358979323846
@@ -131,6 +148,18 @@ using namespace glm;
 #ifndef NUM_LIGHT
   #define NUM_LIGHT 3
 #endif
+#ifndef MESH_LOAD_FLAGS
+  #define MESH_LOAD_FLAGS 0 /* MESH_SPLIT_16BIT splits meshes too large for 16 bit indices, MESH_KEEP_ORDER keeps the file order */
+#endif
+#ifndef LOD_PIXEL_ERROR
+  #define LOD_PIXEL_ERROR 1.0f /* largest screen space error of a chosen level of detail, in pixels */
+#endif
+#ifndef PROFILE_FILE
+  #define PROFILE_FILE "profile.txt" /* written on key 'f' */
+#endif
+#ifndef FAR_PLANE
+  #define FAR_PLANE 50.0f /* far clipping plane, also the depth range of the render queue keys */
+#endif
 #ifndef	BILLBOARD_ROTATION_X
   #define BILLBOARD_ROTATION_X 30
 #endif
@@ -142,8 +171,23 @@ using namespace glm;
 #endif
 /*----------------------------------------------------------------*/
 
+#ifndef PARTICLE_COUNT
+  #define PARTICLE_COUNT 20000
+#endif
+#ifndef PARTICLE_RING_REGIONS
+  #define PARTICLE_RING_REGIONS 3 /* frames of particle positions in the persistently mapped ring */
+#endif
+#ifndef PARTICLE_INTERACTION_RADIUS
+  #define PARTICLE_INTERACTION_RADIUS 0.25f /* particles closer than this push each other apart */
+#endif
+#ifndef PARTICLE_REPULSION
+  #define PARTICLE_REPULSION 0.05f
+#endif
+#ifndef PARTICLE_GRAIN
+  #define PARTICLE_GRAIN 4096 /* particles per chunk of the parallel update, a multiple of the SIMD width */
+#endif
+
 enum {
-  PARTICLE_COUNT          = 20000,
   MAX_ATTRACTORS          = 1
 };
 
@@ -153,29 +197,61 @@ GLboolean anim = GL_TRUE;
 /* To switch between automatic and the two manual camera modes */
 int camMode = 0;
 
-/* Define handles to vertex buffer objects */
+/* Define handles to interleaved vertex buffer objects (position, normal, uv, material index) */
 GLuint VBO[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
 
 /* Define handles to index buffer objects */
 GLuint IBO[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
 
-/* Define handles to normal buffer objects */
-GLuint NBO[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+GLuint VAO[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
 
-/* Define handles to material index buffer objects */
-GLuint MBO[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+/* Objects sharing one mesh are drawn as instances of a group with a single instanced draw call;
+ * the group's VAO adds a per-instance model matrix taken from instanceBuffer */
+struct InstanceGroup {
+  int objectCount;
+  int objects[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+  int visibleCount; /* instances in the buffer this frame, only those inside the view frustum */
+  GLuint VAO;
+  GLuint instanceBuffer;
+};
 
-/* Define handles to texture coord buffer */
-GLuint TBO[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+InstanceGroup instanceGroups[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+int instanceGroupCount = 0;
 
-GLuint VAO[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+/* The instance group drawing each object, -1 if it is drawn on its own */
+int objectInstanceGroup[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+
+/* Define handles to the uniform buffers of the lights and of each object's materials */
+GLuint LightUBO;
+GLuint MaterialUBO[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+
+/* Draw calls of the current frame, sorted by shader, materials, mesh and depth */
+render_queue renderQueue;
+
+/* Hierarchy over the world space bounds of all objects; the static objects form a subtree
+ * built once, the animated ones keep their arrangement and their subtree is refitted every frame */
+bvh sceneBVH;
+int dynamicSubtree = -1;
+mesh_bounds objectBounds[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+
+/* Object picked with the mouse in examine mode, -1 for none */
+int selectedObject = -1;
 
-// Posisition and velocity buffers for particles
+/* Objects inside the view frustum this frame and the culling counters */
+int objectVisible[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+int staticVisible = 1;
+int visibleObjectCount = 0;
+int culledObjectCount = 0;
+int drawnTriangleCount = 0;
+
+/* Frame profiler and its sections */
+profiler frameProfiler;
+int profileCulling, profileMeshes, profileParticles;
+int profileParticleUpdate, profileParticleSimulation, profileAnimation, profileCamera;
+int reportTime = 0;
+
+// Posisition buffer for particles, the velocities stay on the CPU
 GLuint particle_position_buffer;
-GLuint particle_velocity_buffer;
-// Texture buffers for particles
-GLuint particle_position_tbo;
-GLuint particle_velocity_tbo;
 
 /* texture image, for now just 1 hardcoded for testing puposes */
 unsigned char* image;
@@ -184,7 +260,7 @@ unsigned char* image;
 static GLuint billboardTexture;
 
 /* Indices to vertex attributes */ 
-enum DataID {vPosition = 0, vNormal = 1, MaterialIndex = 2, texCoord = 3}; 
+enum DataID {vPosition = 0, vNormal = 1, MaterialIndex = 2, texCoord = 3, InstanceMatrix = 4 /* to 7 */}; 
 
 /* Strings for loading and storing shader code */
 static const char* VertexShaderString;
@@ -219,23 +295,35 @@ float manualSpeed = 0.2f;
 // last measured mouse coordinates
 int xold, yold = 0;
 
-/* Arrays for holding vertex data of models */
-GLfloat *vertex_buffer_data[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+// mouse coordinates of the last button press, to tell clicks from drags
+int xpress, ypress = 0;
 
-/* Arrays for holding indices of models */
-GLushort *index_buffer_data[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+/* Packed meshes loaded from OBJ files, uploaded as they are */
+obj_mesh meshes[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
 
-/* Arrays for holding normals of models */
-GLfloat *normal_buffer_data[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+/* The static objects pre-transformed into one mesh that is drawn with a single call at
+ * their full level of detail; staticMerged stays 0 if they do not fit the shader's
+ * material block */
+obj_mesh staticMesh;
+int staticMerged = 0;
+int objectMerged[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+GLuint staticVBO, staticIBO, staticVAO, staticMaterialUBO;
 
-/* Arrays for holding indices of materials */
-GLushort *material_index_buffer_data[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+/* A distinct model file, parsed once on the worker pool */
+typedef struct {
+  const char* filename;
+  obj_mesh mesh;
+  int success;
+} MeshLoadJob;
 
-/* Arrays for holding texture coordinates of vertices */
-GLfloat *texture_buffer_data[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+MeshLoadJob meshLoadJobs[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+int meshLoadJobCount = 0;
 
-/* Structures for loading of OBJ data */
-obj_scene_data data[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+/* The load job providing the mesh of each object */
+int objectMeshJob[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+
+/* Worker threads for loading */
+thread_pool workerPool;
 
 // Attractors
 vec4 attractors[MAX_ATTRACTORS];
@@ -246,6 +334,52 @@ float attractor_masses[MAX_ATTRACTORS];
 //Particle VAO
 GLuint particle_vao;
 
+// Particle state as structure of arrays and the update kernel the CPU supports
+particle_system particles;
+particle_kernel particleKernel;
+
+// Optional repulsion between neighboring particles, found through a spatial hash grid
+int particleInteraction = 0;
+particle_grid particleGrid;
+
+// One update step of the particles, run by the worker threads
+struct ParticleStep {
+  float delta;
+  float attractors[MAX_ATTRACTORS*4];
+  float* positions;
+};
+
+// Pipelined mode simulates one frame ahead into the other staging buffer while the last step is uploaded
+int particlePipelined = 1;
+int particleJobRunning = 0;
+thread_range_job particleJob;
+ParticleStep particleStep;
+float* particleStaging[2];
+int particleStagingIndex = 0;
+
+// With buffer storage the position buffer is a persistently mapped ring of PARTICLE_RING_REGIONS
+// regions; a fence after each draw tells when its region may be written again. Without it the
+// staging buffers are streamed into an orphaned buffer
+float* particleRingMemory = NULL;
+GLsync particleRingFences[PARTICLE_RING_REGIONS];
+int particleRingRegion = 0; /* region drawn this frame */
+int particleJobRegion = -1; /* region the running pipelined step writes */
+
+// GPU simulation with transform feedback; the state stays on the GPU in two sets of
+// position and velocity buffers, each step reads one set and writes the other
+int particleGPU = 0;
+GLuint particleSimulationProgram = 0; /* 0 if the GPU path is unavailable */
+GLuint particleStateBuffers[2][2];
+GLuint particleSimulationVAO[2];
+GLuint particleDrawVAO[2];
+int particleStateSet = 0;
+
+struct {
+  GLint delta;
+  GLint attractors;
+  GLint attractorCount;
+} particleSimulationUniforms;
+
 /* Reference time for animation */
 int oldTime = 0;
 float elapsedTime = 0;  //in s
@@ -301,7 +435,6 @@ struct Light {
 };
 typedef struct Light Light;
 Light lights[NUM_LIGHT];
-char lightAttributes[9][32]; //the attribute names in the shader, for easier access
 
 //structure for material properties
 struct Material {
@@ -309,7 +442,82 @@ struct Material {
   GLfloat diffuse[3];
   GLfloat specular[3];
 };
-char materialAttributes[3][32]; //the attribute names in the shader, for easier access
+
+enum {
+  MAX_SHADER_LIGHTS       = 10, /* MAX_LIGHTS in the fragment shader */
+  MAX_SHADER_MATERIALS    = 10  /* MAX_MATERIALS in the fragment shader */
+};
+
+/* Shader variants in the render queue keys; plain draws sort before instanced ones */
+enum ShaderVariant {PlainShader = 0, InstancedShader = 1};
+
+/* Most draws merged into one glMultiDrawElementsBaseVertex call */
+enum {MAX_MULTI_DRAW = 64};
+
+/* Uniform buffer binding points of the light and material blocks */
+enum BlockBinding {LightBlockBinding = 0, MaterialBlockBinding = 1};
+
+/* std140 layout of the shader's Light struct: vec3 members start on 16 bytes,
+ * a following float fills the fourth component, the struct size is a multiple of 16 */
+struct LightBlockEntry {
+  GLint isEnabled;
+  GLint type;
+  GLint padding0[2];
+  GLfloat ambient[3];
+  GLfloat padding1;
+  GLfloat color[3];
+  GLfloat padding2;
+  GLfloat position[3];
+  GLfloat padding3;
+  GLfloat coneDirection[3];
+  GLfloat coneCutOffAngleCos;
+  GLfloat attenuation;
+  GLfloat intensity;
+  GLfloat padding4[2];
+};
+
+/* Mirrors the LightBlock uniform block */
+struct LightBlock {
+  LightBlockEntry lights[MAX_SHADER_LIGHTS];
+  GLint light_count;
+  GLint padding[3];
+};
+
+/* std140 layout of the shader's Material struct */
+struct MaterialBlockEntry {
+  GLfloat ambient[3];
+  GLfloat padding0;
+  GLfloat diffuse[3];
+  GLfloat padding1;
+  GLfloat specular[3];
+  GLfloat padding2;
+};
+
+/* Mirrors the MaterialBlock uniform block */
+struct MaterialBlock {
+  MaterialBlockEntry materials[MAX_SHADER_MATERIALS];
+  GLint material_count;
+  GLint padding[3];
+};
+
+/* Light block uploaded last, compared each frame to skip unchanged uploads */
+LightBlock lightBlock;
+GLboolean lightBlockValid = GL_FALSE;
+
+/* Uniform locations of the shader program, resolved once after linking by ResolveUniforms */
+struct ShaderUniforms {
+  GLint PVM_Matrix;
+  GLint VM_Matrix;
+  GLint NormalMatrix;
+  GLint ProjectionMatrix;
+  GLint ViewMatrix;
+  GLint instancedRendering;
+  GLint ambientRendering;
+  GLint diffuseRendering;
+  GLint specularRendering;
+  GLint particleRendering;
+};
+ShaderUniforms uniforms;
 
 
 /******************************************************************
@@ -384,184 +592,364 @@ void BillboardScreen() {
 
 /******************************************************************
 *
-* Display
+* UpdateLightBlock
 *
-* This function is called when the content of the window needs to be
-* drawn/redrawn. It has been specified through 'glutDisplayFunc()';
-* Enable vertex attributes, create binding between C program and 
-* attribute name in shader, provide data for uniform variables
+* Builds the light block of the current frame with positions in
+* view space and uploads it if it differs from the last upload
 *
 *******************************************************************/
 
-void Display() {
-  /* Clear window; color specified in 'Initialize()' */
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+void UpdateLightBlock() {
+  LightBlock block;
+  memset(&block, 0, sizeof(LightBlock));
+  block.light_count = NUM_LIGHT < MAX_SHADER_LIGHTS ? NUM_LIGHT : MAX_SHADER_LIGHTS;
+
+  for (int i = 0; i < block.light_count; i++) {
+    LightBlockEntry *light = &(block.lights[i]);
+    vec3 color = hsvToRgb(lights[i].color);
+
+    /* the spotlight with index 2 moves with the advanced animation */
+    mat4 transform = i == 2 ? ViewMatrix * ModelMatrix[NUM_STATIC+NUM_BASIC_ANIM] : ViewMatrix;
+    vec4 position = transform * vec4(lights[i].position[0], lights[i].position[1], lights[i].position[2], 1.0);
+
+    light->isEnabled = lights[i].isEnabled;
+    light->type = lights[i].type;
+    for (int c = 0; c < 3; c++) {
+      light->ambient[c] = lights[i].ambient[c];
+      light->color[c] = color[c];
+      light->position[c] = position[c];
+      light->coneDirection[c] = lights[i].coneDirection[c];
+    }
+    light->coneCutOffAngleCos = lights[i].coneCutOffAngleCos;
+    light->attenuation = lights[i].attenuation;
+    light->intensity = lights[i].intensity;
+  }
 
-  /* Associate program with shader matrices */
-  GLint PVM_Uniform = glGetUniformLocation(ShaderProgram, "PVM_Matrix");    
-  GLint VM_Uniform = glGetUniformLocation(ShaderProgram, "VM_Matrix");
-  GLint NormalUniform = glGetUniformLocation(ShaderProgram, "NormalMatrix");
+  if (lightBlockValid && memcmp(&block, &lightBlock, sizeof(LightBlock)) == 0) {
+    return;
+  }
 
-  GLuint light_attribute;
+  glBindBuffer(GL_UNIFORM_BUFFER, LightUBO);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightBlock), &block);
+  lightBlock = block;
+  lightBlockValid = GL_TRUE;
+}
 
-  /* set lights in shader */
-  for (int i = 0; i < NUM_LIGHT; i++) {
-    //only support 10 lights maximum
-    if (i == 10) {
-      break;
+
+/******************************************************************
+*
+* CullObjects
+*
+* Moves the bounds of the animated objects by their model matrices,
+* refits their part of the scene hierarchy and marks the objects it
+* finds inside the planes of the view frustum
+*
+*******************************************************************/
+
+void CullObjects() {
+  frustum_planes planes;
+  int visible[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+
+  for (int i = NUM_STATIC; i < NUM_STATIC + NUM_BASIC_ANIM + NUM_ADV_ANIM; i++) {
+    frustum_transform_bounds(&(meshes[i].bounds), value_ptr(ModelMatrix[i]), &(objectBounds[i]));
   }
-  char c = 48+i;
+  bvh_refit(&sceneBVH, dynamicSubtree, objectBounds);
 
-  //set the light attributes
-  lightAttributes[0][7] = c;
-  light_attribute = glGetUniformLocation(ShaderProgram, lightAttributes[0]);
-  glUniform1i(light_attribute, lights[i].isEnabled);
+  frustum_from_matrix(&planes, value_ptr(ProjectionMatrix * ViewMatrix));
+  visibleObjectCount = bvh_query_frustum(&sceneBVH, &planes, visible);
+  culledObjectCount = NUM_STATIC + NUM_BASIC_ANIM + NUM_ADV_ANIM - visibleObjectCount;
 
-  lightAttributes[1][7] = c;
-  light_attribute = glGetUniformLocation(ShaderProgram, lightAttributes[1]);
-  glUniform1i(light_attribute, lights[i].type);
+  memset(objectVisible, 0, sizeof(objectVisible));
+  for (int k = 0; k < visibleObjectCount; k++) {
+    objectVisible[visible[k]] = 1;
+  }
 
-  lightAttributes[2][7] = c;
-  light_attribute = glGetUniformLocation(ShaderProgram, lightAttributes[2]);
-  glUniform3f(light_attribute, lights[i].ambient[0], lights[i].ambient[1], lights[i].ambient[2]);
+  /* the merged static mesh is drawn if any of its parts is visible */
+  staticVisible = 0;
+  for (int i = 0; i < NUM_STATIC; i++) {
+    staticVisible |= objectMerged[i] && objectVisible[i];
+  }
+}
 
-  lightAttributes[3][7] = c;
-  light_attribute = glGetUniformLocation(ShaderProgram, lightAttributes[3]);
-  glUniform3fv(light_attribute, 1, value_ptr(hsvToRgb(lights[i].color)));
 
-  lightAttributes[4][7] = c;
-  light_attribute = glGetUniformLocation(ShaderProgram, lightAttributes[4]);
+/******************************************************************
+*
+* UpdateInstanceBuffers
+*
+* Copies the model matrices of the visible instanced objects into
+* the instance buffers of their groups; called every frame from
+* Display after CullObjects
+*
+*******************************************************************/
 
-  vec4 positions = ViewMatrix * vec4(lights[i].position[0], lights[i].position[1], lights[i].position[2], 1.0);
-  glUniform3f(light_attribute, positions[0], positions[1], positions[2]);
+void UpdateInstanceBuffers() {
+  mat4 instanceMatrices[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
 
-  lightAttributes[5][7] = c;
-  light_attribute = glGetUniformLocation(ShaderProgram, lightAttributes[5]);
-  glUniform3f(light_attribute, lights[i].coneDirection[0], lights[i].coneDirection[1], lights[i].coneDirection[2]);
+  for (int g = 0; g < instanceGroupCount; g++) {
+    InstanceGroup *group = &(instanceGroups[g]);
 
-  lightAttributes[6][7] = c;
-  light_attribute = glGetUniformLocation(ShaderProgram, lightAttributes[6]);
-  glUniform1f(light_attribute, lights[i].coneCutOffAngleCos);
+    group->visibleCount = 0;
+    for (int k = 0; k < group->objectCount; k++) {
+      if (objectVisible[group->objects[k]]) {
+        instanceMatrices[group->visibleCount++] = ModelMatrix[group->objects[k]];
+      }
+    }
 
-  lightAttributes[7][7] = c;
-  light_attribute = glGetUniformLocation(ShaderProgram, lightAttributes[7]);
-  glUniform1f(light_attribute, lights[i].attenuation);
+    if (group->visibleCount > 0) {
+      glBindBuffer(GL_ARRAY_BUFFER, group->instanceBuffer);
+      glBufferSubData(GL_ARRAY_BUFFER, 0, group->visibleCount*sizeof(mat4), instanceMatrices);
+    }
+  }
+}
+
+
+/******************************************************************
+*
+* SelectLOD
+*
+* Picks the coarsest level of detail of an object's mesh whose error,
+* projected at the distance of the nearest point of its bounding
+* sphere, stays within LOD_PIXEL_ERROR pixels
+*
+*******************************************************************/
 
-  lightAttributes[8][7] = c;
-  light_attribute = glGetUniformLocation(ShaderProgram, lightAttributes[8]);
-  glUniform1f(light_attribute, lights[i].intensity);
+int SelectLOD(int object) {
+  obj_mesh *mesh = &(meshes[object]);
+  mesh_bounds *bounds = &(objectBounds[object]);
+
+  if (mesh->lod_count <= 1) {
+    return 0;
+  }
+
+  float distance = length(vec3(ViewMatrix * vec4(make_vec3(bounds->center), 1.0f))) - bounds->radius;
+  if (distance <= 0.0f) {
+    return 0;
+  }
+
+  /* world units per model unit, and pixels per world unit at that distance */
+  float scale = mesh->bounds.radius > 0.0f ? bounds->radius / mesh->bounds.radius : 1.0f;
+  float pixelsPerUnit = ProjectionMatrix[1][1] * 0.5f * glutGet(GLUT_WINDOW_HEIGHT) / distance;
+
+  int lod = 0;
+  while (lod + 1 < mesh->lod_count && mesh->lods[lod + 1].error * scale * pixelsPerUnit <= LOD_PIXEL_ERROR) {
+    lod++;
+  }
+  return lod;
+}
+
+
+/******************************************************************
+*
+* QueueMesh
+*
+* Adds a render queue item for each chunk of a mesh, or for the
+* index range of a coarser level of detail; object is the model
+* matrix to use, -1 if the vertices need none
+*
+*******************************************************************/
+
+void QueueMesh(obj_mesh* mesh, int lod, unsigned int shader, GLuint vertexArray, GLuint materialBuffer,
+               int object, int instanceCount, float depth) {
+  unsigned long long key = render_key(shader, materialBuffer, vertexArray, depth);
+
+  for (int c = 0; c < mesh->chunk_count; c++) {
+    /* meshes with levels of detail have a single chunk */
+    int firstIndex = lod > 0 ? mesh->lods[lod].first_index : mesh->chunks[c].first_index;
+    int indexCount = lod > 0 ? mesh->lods[lod].index_count : mesh->chunks[c].index_count;
+
+    render_item *item = render_queue_add(&renderQueue);
+    item->key = key;
+    item->shader = shader;
+    item->vertex_array = vertexArray;
+    item->material_buffer = materialBuffer;
+    item->object = object;
+    item->index_type = mesh->index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    item->index_count = indexCount;
+    item->index_offset = (size_t)firstIndex*mesh->index_size;
+    item->base_vertex = mesh->chunks[c].base_vertex;
+    item->instance_count = instanceCount;
+
+    drawnTriangleCount += indexCount/3 * (instanceCount > 0 ? instanceCount : 1);
   }
+}
+
 
-  /* animate the animated spotlight */
-  light_attribute = glGetUniformLocation(ShaderProgram, "lights[2].position");
-  vec4 positions = ViewMatrix * ModelMatrix[NUM_STATIC+NUM_BASIC_ANIM] * vec4(lights[2].position[0], lights[2].position[1], lights[2].position[2], 1.0);
-  glUniform3f(light_attribute, positions[0], positions[1], positions[2]);
+/******************************************************************
+*
+* FillRenderQueue
+*
+* Adds the visible parts of the merged static mesh, the objects drawn
+* on their own and the instance groups to the render queue, each at
+* the level of detail its distance allows; the key orders them by
+* shader, materials and mesh, and front to back within those
+*
+*******************************************************************/
 
-  /* draw Meshes */
+void FillRenderQueue() {
   int numObjects = NUM_STATIC + NUM_BASIC_ANIM + NUM_ADV_ANIM;
 
+  render_queue_clear(&renderQueue);
+  drawnTriangleCount = 0;
+
+  if (staticMerged && staticVisible) {
+    QueueMesh(&staticMesh, 0, PlainShader, staticVAO, staticMaterialUBO, -1, 0, 0.0f);
+  }
+
   for (int i = 0; i < numObjects; i++) {
-    /* bind vertex buffer */
-    glEnableVertexAttribArray(vPosition);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO[i]);
-    glVertexAttribPointer(vPosition, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-    /* bind index buffer */
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO[i]);
-    GLint size; 
-    glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
-
-    /* bind normal buffer */
-    glEnableVertexAttribArray(vNormal);
-    glBindBuffer(GL_ARRAY_BUFFER, NBO[i]);
-    glVertexAttribPointer(vNormal, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-    /* bind material buffer */
-    glEnableVertexAttribArray(MaterialIndex);
-    glBindBuffer(GL_ARRAY_BUFFER, MBO[i]);
-    glVertexAttribPointer(MaterialIndex, 1, GL_INT, GL_FALSE, 0, 0);
-
-    /* bind texture uv */
-    glEnableVertexAttribArray(texCoord);
-    glBindBuffer(GL_ARRAY_BUFFER, TBO[i]);
-    glVertexAttribPointer(texCoord, 2, GL_FLOAT, GL_FALSE, 0, 0);
-
-    /* set model matrix */
-    mat4 vm = ViewMatrix * ModelMatrix[i];
-    glUniformMatrix4fv(PVM_Uniform, 1, GL_FALSE, value_ptr(ProjectionMatrix * vm));
-    glUniformMatrix4fv(VM_Uniform, 1, GL_FALSE, value_ptr(vm));
-    glUniformMatrix4fv(NormalUniform, 1, GL_FALSE, value_ptr(transpose(inverse(ModelMatrix[i]*ViewMatrix))));
-
-    /* set material index */
-    GLuint material_count = glGetUniformLocation(ShaderProgram, "material_count");
-    glUniform1i(material_count, data[i].material_count);
-
-    /* set render flags */
-    GLuint ambientRenderingLoc = glGetUniformLocation(ShaderProgram, "ambientRendering");
-    glUniform1i(ambientRenderingLoc, ambientRendering);
-    GLuint diffuseRenderingLoc = glGetUniformLocation(ShaderProgram, "diffuseRendering");
-    glUniform1i(diffuseRenderingLoc, diffuseRendering);
-    GLuint specularRenderingLoc = glGetUniformLocation(ShaderProgram, "specularRendering");
-    glUniform1i(specularRenderingLoc, specularRendering);
-    GLuint particleRenderingLoc = glGetUniformLocation(ShaderProgram, "particleRendering");
-    glUniform1i(particleRenderingLoc, 0);
-
-    GLuint ambLoc;
-    GLuint diffLoc;
-    GLuint specLoc;
-    GLfloat ambient[3];
-    GLfloat diffuse[3];
-    GLfloat specular[3];
-
-    for(int z = 0; z < data[i].material_count; z++) {
-      char c = 48+z;
-
-      materialAttributes[0][10] = c;
-
-      ambLoc = glGetUniformLocation(ShaderProgram, materialAttributes[0]);
-      ambient[0] = (GLfloat)(*(data[i]).material_list[z]).amb[0];
-      ambient[1] = (GLfloat)(*(data[i]).material_list[z]).amb[1];
-      ambient[2] = (GLfloat)(*(data[i]).material_list[z]).amb[2];
-      glUniform3f(ambLoc, ambient[0], ambient[1], ambient[2]);
-
-      materialAttributes[1][10] = c;
-
-      diffLoc = glGetUniformLocation(ShaderProgram, materialAttributes[1]);
-      diffuse[0] = (GLfloat)(*(data[i]).material_list[z]).diff[0];
-      diffuse[1] = (GLfloat)(*(data[i]).material_list[z]).diff[1];
-      diffuse[2] = (GLfloat)(*(data[i]).material_list[z]).diff[2];
-      glUniform3f(diffLoc, diffuse[0], diffuse[1], diffuse[2]);
-
-      materialAttributes[2][10] = c;
-
-      specLoc = glGetUniformLocation(ShaderProgram, materialAttributes[2]);
-      specular[0] = (GLfloat)(*(data[i]).material_list[z]).spec[0];
-      specular[1] = (GLfloat)(*(data[i]).material_list[z]).spec[1];
-      specular[2] = (GLfloat)(*(data[i]).material_list[z]).spec[2];
-      glUniform3f(specLoc, specular[0], specular[1], specular[2]);
-    }
-
-    /* Issue draw command, using indexed triangle list */
-    glDrawElements(GL_TRIANGLES, size/sizeof(GLushort), GL_UNSIGNED_SHORT, 0);
-
-    glDisableVertexAttribArray(vPosition);
-    glDisableVertexAttribArray(vNormal);
-    glDisableVertexAttribArray(MaterialIndex);
-    glDisableVertexAttribArray(texCoord);
-  }
-
-  glUniformMatrix4fv(PVM_Uniform, 1, GL_FALSE, value_ptr(ProjectionMatrix * ViewMatrix));
-  GLuint particleRenderingLoc = glGetUniformLocation(ShaderProgram, "particleRendering");
-  glUniform1i(particleRenderingLoc, 1);
-  glEnableVertexAttribArray(vPosition);
-  glBindBuffer(GL_ARRAY_BUFFER, particle_position_buffer);
-  glVertexAttribPointer(vPosition, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    int group = objectInstanceGroup[i];
+    if (group >= 0 ? (instanceGroups[group].objects[0] != i || instanceGroups[group].visibleCount == 0) : (!objectVisible[i] || objectMerged[i])) {
+      continue;
+    }
+
+    /* view space distance of the object's origin */
+    float depth = -(ViewMatrix * ModelMatrix[i])[3][2] / FAR_PLANE;
+
+    if (group >= 0) {
+      /* all instances share one level of detail, the one the nearest visible instance needs */
+      InstanceGroup *instances = &(instanceGroups[group]);
+      int lod = meshes[i].lod_count - 1;
+      for (int k = 0; k < instances->objectCount; k++) {
+        if (objectVisible[instances->objects[k]]) {
+          int instanceLod = SelectLOD(instances->objects[k]);
+          lod = instanceLod < lod ? instanceLod : lod;
+        }
+      }
+
+      QueueMesh(&(meshes[i]), lod, InstancedShader, instances->VAO, MaterialUBO[i],
+                -1, instances->visibleCount, depth);
+    }
+    else {
+      QueueMesh(&(meshes[i]), SelectLOD(i), PlainShader, VAO[i], MaterialUBO[i], i, 0, depth);
+    }
+  }
+}
+
+
+/******************************************************************
+*
+* Display
+*
+* This function is called when the content of the window needs to be
+* drawn/redrawn. It has been specified through 'glutDisplayFunc()';
+* Enable vertex attributes, create binding between C program and 
+* attribute name in shader, provide data for uniform variables
+*
+*******************************************************************/
+
+void Display() {
+  profiler_begin_frame(&frameProfiler);
+
+  /* Clear window; color specified in 'Initialize()' */
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  /* set lights in shader */
+  UpdateLightBlock();
+
+  /* set render flags */
+  glUniform1i(uniforms.ambientRendering, ambientRendering);
+  glUniform1i(uniforms.diffuseRendering, diffuseRendering);
+  glUniform1i(uniforms.specularRendering, specularRendering);
+  glUniform1i(uniforms.particleRendering, 0);
+
+  /* draw Meshes inside the view frustum, sorted by render state */
+  profiler_begin(&frameProfiler, profileCulling);
+  CullObjects();
+  UpdateInstanceBuffers();
+  FillRenderQueue();
+  render_queue_sort(&renderQueue);
+  profiler_end(&frameProfiler, profileCulling);
+
+  profiler_begin(&frameProfiler, profileMeshes);
+
+  /* the instanced shader takes the model matrices from the instance buffers */
+  glUniformMatrix4fv(uniforms.ProjectionMatrix, 1, GL_FALSE, value_ptr(ProjectionMatrix));
+  glUniformMatrix4fv(uniforms.ViewMatrix, 1, GL_FALSE, value_ptr(ViewMatrix));
+
+  GLuint boundVAO = 0;
+  GLuint boundMaterials = 0;
+  unsigned int boundShader = PlainShader;
+  int boundObject = -2; /* -1 is the merged static mesh */
+
+  for (int first = 0, end; first < renderQueue.item_count; first = end) {
+    end = render_queue_batch_end(&renderQueue, first);
+    if (end - first > MAX_MULTI_DRAW) {
+      end = first + MAX_MULTI_DRAW;
+    }
+    render_item *item = &(renderQueue.sorted[first]);
+
+    /* only change the state that differs from the previous batch */
+    if (item->shader != boundShader) {
+      glUniform1i(uniforms.instancedRendering, item->shader == InstancedShader);
+      boundShader = item->shader;
+    }
+    if (item->vertex_array != boundVAO) {
+      glBindVertexArray(item->vertex_array);
+      boundVAO = item->vertex_array;
+    }
+    if (item->material_buffer != boundMaterials) {
+      glBindBufferBase(GL_UNIFORM_BUFFER, MaterialBlockBinding, item->material_buffer);
+      boundMaterials = item->material_buffer;
+    }
+    if (item->shader == PlainShader && item->object != boundObject) {
+      /* merged static geometry is already in world space */
+      mat4 model = item->object >= 0 ? ModelMatrix[item->object] : mat4(1.0f);
+      mat4 vm = ViewMatrix * model;
+      glUniformMatrix4fv(uniforms.PVM_Matrix, 1, GL_FALSE, value_ptr(ProjectionMatrix * vm));
+      glUniformMatrix4fv(uniforms.VM_Matrix, 1, GL_FALSE, value_ptr(vm));
+      glUniformMatrix4fv(uniforms.NormalMatrix, 1, GL_FALSE, value_ptr(transpose(inverse(model*ViewMatrix))));
+      boundObject = item->object;
+    }
+
+    if (item->instance_count > 0) {
+      glDrawElementsInstancedBaseVertex(GL_TRIANGLES, item->index_count, item->index_type,
+                                        (GLvoid*)item->index_offset, item->instance_count, item->base_vertex);
+    }
+    else if (end - first == 1) {
+      glDrawElementsBaseVertex(GL_TRIANGLES, item->index_count, item->index_type,
+                               (GLvoid*)item->index_offset, item->base_vertex);
+    }
+    else {
+      /* the chunks of one object share all state and go out in one call */
+      GLsizei counts[MAX_MULTI_DRAW];
+      const GLvoid *offsets[MAX_MULTI_DRAW];
+      GLint baseVertices[MAX_MULTI_DRAW];
+
+      for (int d = 0; d < end - first; d++) {
+        counts[d] = item[d].index_count;
+        offsets[d] = (const GLvoid*)item[d].index_offset;
+        baseVertices[d] = item[d].base_vertex;
+      }
+      glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts, item->index_type, offsets, end - first, baseVertices);
+    }
+  }
+  if (boundShader != PlainShader) {
+    glUniform1i(uniforms.instancedRendering, 0);
+  }
+  profiler_end(&frameProfiler, profileMeshes);
+
+  profiler_begin(&frameProfiler, profileParticles);
+  glUniformMatrix4fv(uniforms.PVM_Matrix, 1, GL_FALSE, value_ptr(ProjectionMatrix * ViewMatrix));
+  glUniform1i(uniforms.particleRendering, 1);
+  glBindVertexArray(particleGPU ? particleDrawVAO[particleStateSet] : particle_vao);
   //glEnable(GL_BLEND);
   //glBlendFunc(GL_ONE, GL_ONE);
   //glPointSize(1.4f);
-  glDrawArrays(GL_POINTS, 0, PARTICLE_COUNT);
-  glDisableVertexAttribArray(vPosition);
+  if (particleGPU) {
+    glDrawArrays(GL_POINTS, 0, PARTICLE_COUNT);
+  }
+  else {
+    glDrawArrays(GL_POINTS, particleRingMemory ? particleRingRegion * PARTICLE_COUNT : 0, PARTICLE_COUNT);
+    if (particleRingMemory) {
+      /* the region may be written again once this draw is done */
+      if (particleRingFences[particleRingRegion]) {
+        glDeleteSync(particleRingFences[particleRingRegion]);
+      }
+      particleRingFences[particleRingRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+  }
+  glBindVertexArray(0);
   //glDisable(GL_BLEND);
+  profiler_end(&frameProfiler, profileParticles);
 
   /* Add billboard to scenery 
   glClear(GL_COLOR_BUFFER_BIT);
@@ -587,6 +975,55 @@ void Display() {
 }
 
 
+/******************************************************************
+*
+* PickTest
+*
+* Exact hit test of a picking ray with the triangles of an object;
+* the ray is moved into model space, which keeps its parameter t
+*
+*******************************************************************/
+
+float PickTest(int object, const float* origin, const float* direction, void* data) {
+  (void) data;
+  mat4 toModel = inverse(ModelMatrix[object]);
+  vec3 modelOrigin = vec3(toModel * vec4(make_vec3(origin), 1.0f));
+  vec3 modelDirection = vec3(toModel * vec4(make_vec3(direction), 0.0f));
+  obj_mesh *mesh = &(meshes[object]);
+
+  return mesh_intersect_ray(mesh->vertices, mesh->indices, mesh->index_size, mesh->chunks, mesh->chunk_count,
+                            value_ptr(modelOrigin), value_ptr(modelDirection));
+}
+
+
+/******************************************************************
+*
+* PickObject
+*
+* Selects the object under window coordinates x, y by casting a ray
+* from the near to the far plane through the scene hierarchy
+*
+*******************************************************************/
+
+void PickObject(int x, int y) {
+  float ndcX = 2.0f*x/glutGet(GLUT_WINDOW_WIDTH) - 1.0f;
+  float ndcY = 1.0f - 2.0f*y/glutGet(GLUT_WINDOW_HEIGHT);
+  mat4 toWorld = inverse(ProjectionMatrix * ViewMatrix);
+  vec4 nearPoint = toWorld * vec4(ndcX, ndcY, -1.0f, 1.0f);
+  vec4 farPoint = toWorld * vec4(ndcX, ndcY, 1.0f, 1.0f);
+  vec3 origin = vec3(nearPoint) / nearPoint.w;
+  vec3 direction = vec3(farPoint) / farPoint.w - origin;
+
+  selectedObject = bvh_intersect_ray(&sceneBVH, value_ptr(origin), value_ptr(direction), PickTest, NULL, NULL);
+  if (selectedObject >= 0) {
+    printf("Selected object %d (%s)\n", selectedObject, meshLoadJobs[objectMeshJob[selectedObject]].filename);
+  }
+  else {
+    printf("Selected nothing\n");
+  }
+}
+
+
 /******************************************************************
 *
 * Mouse
@@ -600,6 +1037,8 @@ void Mouse(int button, int state, int x, int y) {
   if(state == GLUT_DOWN) {
     xold = x;
     yold = y;
+    xpress = x;
+    ypress = y;
     int scroll_down;
     int scroll_up;
     
@@ -632,6 +1071,12 @@ void Mouse(int button, int state, int x, int y) {
       }
     }
   }
+  else if(state == GLUT_UP && button == GLUT_LEFT_BUTTON && camMode == 2) {
+    /* a click without dragging picks the object under the mouse */
+    if(abs(x - xpress) < 3 && abs(y - ypress) < 3) {
+      PickObject(x, y);
+    }
+  }
 }
 
 
@@ -645,15 +1090,255 @@ void Mouse(int button, int state, int x, int y) {
 *
 *******************************************************************/
 
-void RotateCamera(int x, int y) {
-  if(camMode != 0) {
-    camAngleX = fmod(camAngleX + (y - yold)*0.4, 360.0);
-    camAngleY = fmod(camAngleY + (x - xold)*0.4, 360.0);
-    xold = x;
-    yold = y;
+void RotateCamera(int x, int y) {
+  if(camMode != 0) {
+    camAngleX = fmod(camAngleX + (y - yold)*0.4, 360.0);
+    camAngleY = fmod(camAngleY + (x - xold)*0.4, 360.0);
+    xold = x;
+    yold = y;
+  }
+}
+
+/******************************************************************
+*
+* ParticleRangeTask
+*
+* Updates the particles first to end-1 on a worker thread
+*
+*******************************************************************/
+
+void ParticleRangeTask(void* argument, int first, int end) {
+  ParticleStep *step = (ParticleStep*)argument;
+  particleKernel(&particles, first, end, step->attractors, MAX_ATTRACTORS, step->delta, step->positions);
+}
+
+
+/******************************************************************
+*
+* ParticleRepelTask
+*
+* Applies the repulsion of their neighbors to the particles first
+* to end-1 on a worker thread
+*
+*******************************************************************/
+
+void ParticleRepelTask(void* argument, int first, int end) {
+  ParticleStep *step = (ParticleStep*)argument;
+  particle_repel(&particles, &particleGrid, first, end, PARTICLE_INTERACTION_RADIUS, PARTICLE_REPULSION, step->delta);
+}
+
+
+/******************************************************************
+*
+* AcquireParticleRegion
+*
+* Returns the mapped memory of a region of the particle ring once
+* the GPU has finished drawing from it
+*
+*******************************************************************/
+
+float* AcquireParticleRegion(int region) {
+  GLsync fence = particleRingFences[region];
+
+  if (fence) {
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (glClientWaitSync(fence, flags, 1000000) == GL_TIMEOUT_EXPIRED) {
+      flags = 0;
+    }
+    glDeleteSync(fence);
+    particleRingFences[region] = 0;
+  }
+  return particleRingMemory + region * PARTICLE_COUNT * 4;
+}
+
+
+/******************************************************************
+*
+* UpdateParticles
+*
+* Runs a particle step as a parallel for over the worker pool,
+* after the repulsion between neighbors if that is turned on.
+* Pipelined, the step started in the previous frame is waited for
+* and its positions are drawn while the next step runs, so the
+* particles are drawn one step behind the simulation. Otherwise the
+* step is waited for right away.
+* With the persistent ring every step writes its positions into the
+* next free region; without it the pipelined steps alternate between
+* two staging buffers that are uploaded into an orphaned buffer, and
+* synchronous steps write into the mapped, invalidated buffer
+*
+*******************************************************************/
+
+void UpdateParticles(float delta) {
+  /* the step of the previous frame still reads particleStep */
+  if (particleJobRunning) {
+    thread_pool_parallel_for_wait(&particleJob);
+    particleJobRunning = 0;
+  }
+
+  particleStep.delta = delta;
+  for (int i = 0; i < MAX_ATTRACTORS; i++) {
+    memcpy(&(particleStep.attractors[i*4]), value_ptr(attractors[i]), sizeof(vec4));
+  }
+
+  /* neighbor forces need the positions of the finished step, so they run before the next one starts */
+  if (particleInteraction) {
+    particle_grid_build(&particleGrid, &particles);
+    thread_pool_parallel_for(&workerPool, particles.count, PARTICLE_GRAIN, ParticleRepelTask, &particleStep);
+  }
+
+  if (particleRingMemory) {
+    if (particlePipelined) {
+      if (particleJobRegion >= 0) {
+        particleRingRegion = particleJobRegion;
+      }
+      particleJobRegion = (particleRingRegion + 1) % PARTICLE_RING_REGIONS;
+      particleStep.positions = AcquireParticleRegion(particleJobRegion);
+      thread_pool_parallel_for_begin(&workerPool, &particleJob, particles.count, PARTICLE_GRAIN, ParticleRangeTask, &particleStep);
+      particleJobRunning = 1;
+    }
+    else {
+      int region = (particleRingRegion + 1) % PARTICLE_RING_REGIONS;
+      particleStep.positions = AcquireParticleRegion(region);
+      thread_pool_parallel_for(&workerPool, particles.count, PARTICLE_GRAIN, ParticleRangeTask, &particleStep);
+      particleRingRegion = region;
+      particleJobRegion = -1;
+    }
+    return;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, particle_position_buffer);
+
+  if (particlePipelined) {
+    float *finished = particleStaging[particleStagingIndex];
+    particleStagingIndex = 1 - particleStagingIndex;
+
+    particleStep.positions = particleStaging[particleStagingIndex];
+    thread_pool_parallel_for_begin(&workerPool, &particleJob, particles.count, PARTICLE_GRAIN, ParticleRangeTask, &particleStep);
+    particleJobRunning = 1;
+
+    glBufferData(GL_ARRAY_BUFFER, PARTICLE_COUNT * sizeof(vec4), NULL, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, PARTICLE_COUNT * sizeof(vec4), finished);
+  }
+  else {
+    particleStep.positions = (float *)glMapBufferRange(GL_ARRAY_BUFFER, 0, PARTICLE_COUNT * sizeof(vec4),
+                                                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (particleStep.positions) {
+      thread_pool_parallel_for(&workerPool, particles.count, PARTICLE_GRAIN, ParticleRangeTask, &particleStep);
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+  }
+}
+
+
+/******************************************************************
+*
+* SimulateParticlesGPU
+*
+* Runs a particle step as a point draw with rasterization turned
+* off; the vertex shader's outputs are captured into the other set
+* of state buffers, which then becomes the current one
+*
+*******************************************************************/
+
+void SimulateParticlesGPU(float delta) {
+  int target = 1 - particleStateSet;
+
+  glUseProgram(particleSimulationProgram);
+  glUniform1f(particleSimulationUniforms.delta, delta);
+  glUniform4fv(particleSimulationUniforms.attractors, MAX_ATTRACTORS, value_ptr(attractors[0]));
+  glUniform1i(particleSimulationUniforms.attractorCount, MAX_ATTRACTORS);
+
+  glEnable(GL_RASTERIZER_DISCARD);
+  glBindVertexArray(particleSimulationVAO[particleStateSet]);
+  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, particleStateBuffers[target][0]);
+  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, particleStateBuffers[target][1]);
+
+  glBeginTransformFeedback(GL_POINTS);
+  glDrawArrays(GL_POINTS, 0, PARTICLE_COUNT);
+  glEndTransformFeedback();
+
+  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, 0);
+  glBindVertexArray(0);
+  glDisable(GL_RASTERIZER_DISCARD);
+  glUseProgram(ShaderProgram);
+
+  particleStateSet = target;
+}
+
+
+/******************************************************************
+*
+* SetParticleSimulationMode
+*
+* Moves the particle state between the CPU arrays and the GPU state
+* buffers when switching the simulation mode
+*
+*******************************************************************/
+
+void SetParticleSimulationMode(int gpu) {
+  if (gpu == particleGPU) {
+    return;
+  }
+  if (gpu && particleSimulationProgram == 0) {
+    printf("GPU particle simulation is not available\n");
+    return;
+  }
+
+  vec4 *positions = (vec4 *)malloc(PARTICLE_COUNT * sizeof(vec4));
+  vec4 *velocities = (vec4 *)malloc(PARTICLE_COUNT * sizeof(vec4));
+
+  if (gpu) {
+    /* the CPU step in flight updates the arrays, let it finish */
+    if (particleJobRunning) {
+      thread_pool_parallel_for_wait(&particleJob);
+      particleJobRunning = 0;
+    }
+    particleJobRegion = -1;
+
+    for (int i = 0; i < PARTICLE_COUNT; i++) {
+      positions[i] = vec4(particles.x[i], particles.y[i], particles.z[i], particles.life[i]);
+      velocities[i] = vec4(particles.vx[i], particles.vy[i], particles.vz[i], 0.0f);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, particleStateBuffers[particleStateSet][0]);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, PARTICLE_COUNT * sizeof(vec4), positions);
+    glBindBuffer(GL_ARRAY_BUFFER, particleStateBuffers[particleStateSet][1]);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, PARTICLE_COUNT * sizeof(vec4), velocities);
+  }
+  else {
+    glBindBuffer(GL_ARRAY_BUFFER, particleStateBuffers[particleStateSet][0]);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, PARTICLE_COUNT * sizeof(vec4), positions);
+    glBindBuffer(GL_ARRAY_BUFFER, particleStateBuffers[particleStateSet][1]);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, PARTICLE_COUNT * sizeof(vec4), velocities);
+
+    for (int i = 0; i < PARTICLE_COUNT; i++) {
+      particles.x[i] = positions[i].x;
+      particles.y[i] = positions[i].y;
+      particles.z[i] = positions[i].z;
+      particles.life[i] = positions[i].w;
+      particles.vx[i] = velocities[i].x;
+      particles.vy[i] = velocities[i].y;
+      particles.vz[i] = velocities[i].z;
+    }
+    /* the next CPU frame draws these positions first */
+    if (particleRingMemory) {
+      memcpy(AcquireParticleRegion(particleRingRegion), positions, PARTICLE_COUNT * sizeof(vec4));
+    }
+    else {
+      memcpy(particleStaging[particleStagingIndex], positions, PARTICLE_COUNT * sizeof(vec4));
+    }
   }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  free(positions);
+  free(velocities);
+
+  particleGPU = gpu;
+  printf("Particles are simulated on the %s\n", gpu ? "GPU" : "CPU");
 }
 
+
 /******************************************************************
 *
 * Keyboard
@@ -850,6 +1535,38 @@ void Keyboard(unsigned char key, int x, int y) {
     }
     break;
     
+    /* turn the repulsion between neighboring particles on and off */
+    case 'h':
+      particleInteraction = !particleInteraction;
+      printf("Particle repulsion %s%s\n", particleInteraction ? "on" : "off",
+             particleInteraction && particleGPU ? ", applies to the CPU simulation only" : "");
+    break;
+
+    /* switch between GPU and CPU particle simulation */
+    case 'g':
+      SetParticleSimulationMode(!particleGPU);
+    break;
+
+    /* switch between pipelined and synchronous particle updates */
+    case 'k':
+      particlePipelined = !particlePipelined;
+      printf("Particle simulation %s\n", particlePipelined ? "runs one frame ahead" : "is synchronous");
+    break;
+
+    /* write the frame statistics to a file */
+    case 'f': {
+      FILE *file = fopen(PROFILE_FILE, "w");
+      if (file) {
+        profiler_report(&frameProfiler, file);
+        fclose(file);
+        printf("Frame statistics written to %s\n", PROFILE_FILE);
+      }
+      else {
+        fprintf(stderr, "Error: could not write %s\n", PROFILE_FILE);
+      }
+    }
+    break;
+
     /* quit program */
     case 'q': case 'Q':  
       exit(0);    
@@ -922,7 +1639,13 @@ float moves(double angle, double offset) {
 
 void OnIdle() {
   calculateFPS();
-  printf("%i FPS\n",fps);
+
+  /* report the frame statistics once a second */
+  if (currentTime - reportTime >= 1000) {
+    reportTime = currentTime;
+    printf("%i FPS, %i objects visible, %i culled, %i triangles\n", fps, visibleObjectCount, culledObjectCount, drawnTriangleCount);
+    profiler_report(&frameProfiler, stdout);
+  }
 
   /* Determine delta time between two frames to ensure constant animation */
   int newTime = glutGet(GLUT_ELAPSED_TIME);
@@ -944,43 +1667,19 @@ void OnIdle() {
     attractor_masses[i]);
   }*/
 
-  glBindBuffer(GL_ARRAY_BUFFER, particle_position_buffer);
-  vec4* particlePositions = (vec4 *)glMapBufferRange(GL_ARRAY_BUFFER, 0, PARTICLE_COUNT * sizeof(vec4), GL_MAP_WRITE_BIT);
-  glBindBuffer(GL_ARRAY_BUFFER, particle_velocity_buffer);
-  vec4 * velocities = (vec4 *)glMapBufferRange(GL_ARRAY_BUFFER, 0, PARTICLE_COUNT * sizeof(vec4), GL_MAP_WRITE_BIT);
-  
-  for (int i = 0; i < PARTICLE_COUNT; i++) {
-    vec4 pos = particlePositions[i];
-    vec4 vel = velocities[i];
-    pos.x += vel.x * deltaForParticles;
-    pos.y += vel.y * deltaForParticles;
-    pos.z += vel.z * deltaForParticles;
-    pos.w -= 0.0001 * deltaForParticles;
-
-    for (int j = 0; j < MAX_ATTRACTORS; j++) {
-      vec3 dist = vec3(attractors[j].x - pos.x, attractors[j].y - pos.y, attractors[j].z - pos.z);
-      vel.x += deltaForParticles * deltaForParticles * attractors[j].w * normalize(dist).x / (dot(dist, dist) + 10.0);
-      vel.y += deltaForParticles * deltaForParticles * attractors[j].w * normalize(dist).y / (dot(dist, dist) + 10.0);
-      vel.z += deltaForParticles * deltaForParticles * attractors[j].w * normalize(dist).z / (dot(dist, dist) + 10.0);
-    }
-
-    if (pos.w <= 0.0) {
-      //fprintf(stderr, "particle died\n");
-      pos.x = -pos.x * 0.01;
-      pos.y = -pos.y * 0.01;
-      pos.z = -pos.z * 0.01;
-      vel.x *= 0.01;
-      vel.y *= 0.01;
-      vel.z *= 0.01;
-      pos.w += 1.0f;
-    }
-    particlePositions[i] = pos;
-    velocities[i] = vel;
-  }
-  glUnmapBuffer(GL_ARRAY_BUFFER);
-  glBindBuffer(GL_ARRAY_BUFFER, particle_position_buffer);    
-  glUnmapBuffer(GL_ARRAY_BUFFER);
+  /* update the particles on the GPU or on the worker threads */
+  if (particleGPU) {
+    profiler_begin(&frameProfiler, profileParticleSimulation);
+    SimulateParticlesGPU(deltaForParticles);
+    profiler_end(&frameProfiler, profileParticleSimulation);
+  }
+  else {
+    profiler_begin(&frameProfiler, profileParticleUpdate);
+    UpdateParticles(deltaForParticles);
+    profiler_end(&frameProfiler, profileParticleUpdate);
+  }
 
+  profiler_begin(&frameProfiler, profileAnimation);
   if(anim) {
     /* Increment rotation angles and update matrix */
     angleY = fmod(angleY + delta/20.0, 360.0); 
@@ -1001,8 +1700,10 @@ void OnIdle() {
       delay += 20;
     }
   }
+  profiler_end(&frameProfiler, profileAnimation);
 
   /* Rotate camera */
+  profiler_begin(&frameProfiler, profileCamera);
 
   //automatic camera mode
   if(camMode == 0) {
@@ -1083,70 +1784,214 @@ void OnIdle() {
       ViewMatrix = ViewTransform * RotationMatrixAnim;
     }
   }	
+  profiler_end(&frameProfiler, profileCamera);
 
   /* Issue display refresh */
   glutPostRedisplay();
 }
 
 
+/******************************************************************
+*
+* FillMaterialBlock
+*
+* Converts the materials of a mesh to the std140 layout of the
+* shader's MaterialBlock
+*
+*******************************************************************/
+
+void FillMaterialBlock(MaterialBlock* block, obj_mesh* mesh) {
+  memset(block, 0, sizeof(MaterialBlock));
+  block->material_count = mesh->material_count < MAX_SHADER_MATERIALS ? mesh->material_count : MAX_SHADER_MATERIALS;
+
+  for (int z = 0; z < block->material_count; z++) {
+    for (int c = 0; c < 3; c++) {
+      block->materials[z].ambient[c] = (GLfloat)mesh->materials[z].amb[c];
+      block->materials[z].diffuse[c] = (GLfloat)mesh->materials[z].diff[c];
+      block->materials[z].specular[c] = (GLfloat)mesh->materials[z].spec[c];
+    }
+  }
+}
+
+
+/******************************************************************
+*
+* SetupMeshAttributes
+*
+* Records the interleaved vertex layout and the index buffer of a
+* mesh in the currently bound VAO
+*
+*******************************************************************/
+
+void SetupMeshAttributes(GLuint vertexBuffer, GLuint indexBuffer) {
+  glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+
+  glEnableVertexAttribArray(vPosition);
+  glVertexAttribPointer(vPosition, 3, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex), (GLvoid*)offsetof(mesh_vertex, position));
+  glEnableVertexAttribArray(vNormal);
+  glVertexAttribPointer(vNormal, 3, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex), (GLvoid*)offsetof(mesh_vertex, normal));
+  glEnableVertexAttribArray(texCoord);
+  glVertexAttribPointer(texCoord, 2, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex), (GLvoid*)offsetof(mesh_vertex, texcoord));
+  glEnableVertexAttribArray(MaterialIndex);
+  glVertexAttribIPointer(MaterialIndex, 1, GL_INT, sizeof(mesh_vertex), (GLvoid*)offsetof(mesh_vertex, material_index));
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+}
+
+
+/******************************************************************
+*
+* UploadMesh
+*
+* Creates the vertex, index and material buffers of a mesh
+*
+*******************************************************************/
+
+void UploadMesh(obj_mesh* mesh, GLuint* vertexBuffer, GLuint* indexBuffer, GLuint* materialBuffer) {
+  glGenBuffers(1, vertexBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, *vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, mesh->vertex_count*sizeof(mesh_vertex), mesh->vertices, GL_STATIC_DRAW);
+
+  glGenBuffers(1, indexBuffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, *indexBuffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->index_count*mesh->index_size, mesh->indices, GL_STATIC_DRAW);
+
+  MaterialBlock materialBlock;
+  FillMaterialBlock(&materialBlock, mesh);
+  glGenBuffers(1, materialBuffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, *materialBuffer);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(MaterialBlock), &materialBlock, GL_STATIC_DRAW);
+}
+
+
 /******************************************************************
 *
 * SetupDataBuffers
 *
-* Create buffer objects and load data into buffers
+* Create buffer objects and load data into buffers; the vertex
+* layout of every object is recorded once in its VAO
 *
 *******************************************************************/
 
 void SetupDataBuffers() {
-  glGenVertexArrays(NUM_STATIC + NUM_BASIC_ANIM + NUM_ADV_ANIM, VAO);
+  glGenBuffers(1, &LightUBO);
+  glBindBuffer(GL_UNIFORM_BUFFER, LightUBO);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(LightBlock), NULL, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, LightBlockBinding, LightUBO);
+  lightBlockValid = GL_FALSE;
 
-  for (int i = 0; i < NUM_STATIC + NUM_BASIC_ANIM + NUM_ADV_ANIM; i++) {
-    glGenBuffers(1, &(VBO[i]));
-    glBindBuffer(GL_ARRAY_BUFFER, VBO[i]);
-    glBufferData(GL_ARRAY_BUFFER, (data[i]).vertex_count*3*sizeof(GLfloat), vertex_buffer_data[i], GL_STATIC_DRAW);
+  glGenVertexArrays(NUM_STATIC + NUM_BASIC_ANIM + NUM_ADV_ANIM, VAO);
 
-    glGenBuffers(1, &(IBO[i]));
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO[i]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (data[i]).face_count*3*sizeof(GLushort), index_buffer_data[i], GL_STATIC_READ);
+  /* merged static objects only need the buffers of the merged mesh */
+  if (staticMerged) {
+    UploadMesh(&staticMesh, &staticVBO, &staticIBO, &staticMaterialUBO);
+    glGenVertexArrays(1, &staticVAO);
+    glBindVertexArray(staticVAO);
+    SetupMeshAttributes(staticVBO, staticIBO);
+  }
 
-    glGenBuffers(1, &(NBO[i]));
-    glBindBuffer(GL_ARRAY_BUFFER, NBO[i]);
-    glBufferData(GL_ARRAY_BUFFER, (data[i]).vertex_normal_count*3*sizeof(GLfloat), normal_buffer_data[i], GL_STATIC_READ);
+  for (int i = 0; i < NUM_STATIC + NUM_BASIC_ANIM + NUM_ADV_ANIM; i++) {
+    if (objectMerged[i]) {
+      continue;
+    }
 
-    glGenBuffers(1, &(MBO[i]));
-    glBindBuffer(GL_ARRAY_BUFFER, MBO[i]);
-    glBufferData(GL_ARRAY_BUFFER, (data[i]).face_count*sizeof(GLushort), material_index_buffer_data[i], GL_STATIC_READ);
+    /* objects loaded from the same file share the buffers of the first one */
+    int first = 0;
+    while (objectMeshJob[first] != objectMeshJob[i] || objectMerged[first]) {
+      first++;
+    }
 
-    glGenBuffers(1, &(TBO[i]));
-    glBindBuffer(GL_ARRAY_BUFFER, TBO[i]);
-    glBufferData(GL_ARRAY_BUFFER, (data[i]).vertex_texture_count*2*sizeof(GLfloat), texture_buffer_data[i], GL_STATIC_DRAW);
+    if (first < i) {
+      VBO[i] = VBO[first];
+      IBO[i] = IBO[first];
+      MaterialUBO[i] = MaterialUBO[first];
+    }
+    else {
+      UploadMesh(&(meshes[i]), &(VBO[i]), &(IBO[i]), &(MaterialUBO[i]));
+    }
 
+    /* the VAO records the attribute layout and the index buffer binding */
     glBindVertexArray(VAO[i]);
+    SetupMeshAttributes(VBO[i], IBO[i]);
+  }
 
-    glGenVertexArrays(1, &particle_vao);
-    glBindVertexArray(particle_vao);
+  /* instance groups draw the shared mesh with a per-instance model matrix in attributes 4 to 7 */
+  for (int g = 0; g < instanceGroupCount; g++) {
+    InstanceGroup *group = &(instanceGroups[g]);
 
-    glGenBuffers(1, &particle_position_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, particle_position_buffer);
-    glBufferData(GL_ARRAY_BUFFER, PARTICLE_COUNT * sizeof(vec4), NULL, GL_DYNAMIC_DRAW);
+    glGenVertexArrays(1, &(group->VAO));
+    glBindVertexArray(group->VAO);
+    SetupMeshAttributes(VBO[group->objects[0]], IBO[group->objects[0]]);
 
-    vec4* particlePositions = (vec4 *)glMapBufferRange(GL_ARRAY_BUFFER, 0, PARTICLE_COUNT * sizeof(vec4), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-    
-    for (int i = 0; i < PARTICLE_COUNT; i++) {
-      vec3 randomVec = random_vector(-10.0f, 10.0f);
-      particlePositions[i] = vec4(randomVec.x, randomVec.y, randomVec.z, random_float());
+    glGenBuffers(1, &(group->instanceBuffer));
+    glBindBuffer(GL_ARRAY_BUFFER, group->instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, group->objectCount*sizeof(mat4), NULL, GL_DYNAMIC_DRAW);
+
+    for (int column = 0; column < 4; column++) {
+      glEnableVertexAttribArray(InstanceMatrix + column);
+      glVertexAttribPointer(InstanceMatrix + column, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (GLvoid*)(column*sizeof(vec4)));
+      glVertexAttribDivisor(InstanceMatrix + column, 1);
     }
-    glUnmapBuffer(GL_ARRAY_BUFFER);
+  }
 
-    glGenBuffers(1, &particle_velocity_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, particle_velocity_buffer);
-    glBufferData(GL_ARRAY_BUFFER, PARTICLE_COUNT * sizeof(vec4), NULL, GL_DYNAMIC_DRAW);
-    vec4 * velocities = (vec4 *)glMapBufferRange(GL_ARRAY_BUFFER, 0, PARTICLE_COUNT * sizeof(vec4), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-    for (int i = 0; i < PARTICLE_COUNT; i++) {
-      velocities[i] = vec4(random_vector(-0.1f, 0.1f), 0.0f);
+  glGenVertexArrays(1, &particle_vao);
+  glBindVertexArray(particle_vao);
+
+  /* random start positions and velocities, kept as structure of arrays */
+  particle_system_make(&particles, PARTICLE_COUNT);
+  particle_grid_make(&particleGrid, PARTICLE_COUNT, PARTICLE_INTERACTION_RADIUS);
+  vec4* particlePositions = (vec4 *)malloc(PARTICLE_COUNT * sizeof(vec4));
+
+  for (int i = 0; i < PARTICLE_COUNT; i++) {
+    vec3 randomVec = random_vector(-10.0f, 10.0f);
+    particles.x[i] = randomVec.x;
+    particles.y[i] = randomVec.y;
+    particles.z[i] = randomVec.z;
+    particles.life[i] = random_float();
+    particlePositions[i] = vec4(randomVec, particles.life[i]);
+  }
+  for (int i = 0; i < PARTICLE_COUNT; i++) {
+    vec3 randomVec = random_vector(-0.1f, 0.1f);
+    particles.vx[i] = randomVec.x;
+    particles.vy[i] = randomVec.y;
+    particles.vz[i] = randomVec.z;
+  }
+
+  glGenBuffers(1, &particle_position_buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, particle_position_buffer);
+
+  /* stream the positions through a persistently mapped ring if possible, the first region holds the start positions */
+  if (GLEW_ARB_buffer_storage) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr size = PARTICLE_RING_REGIONS * PARTICLE_COUNT * sizeof(vec4);
+
+    glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+    particleRingMemory = (float *)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    if (particleRingMemory) {
+      memcpy(particleRingMemory, particlePositions, PARTICLE_COUNT * sizeof(vec4));
+    }
+    else {
+      /* buffer storage is immutable, start over with a new buffer */
+      glDeleteBuffers(1, &particle_position_buffer);
+      glGenBuffers(1, &particle_position_buffer);
+      glBindBuffer(GL_ARRAY_BUFFER, particle_position_buffer);
     }
-    glUnmapBuffer(GL_ARRAY_BUFFER);
   }
+  if (!particleRingMemory) {
+    glBufferData(GL_ARRAY_BUFFER, PARTICLE_COUNT * sizeof(vec4), particlePositions, GL_DYNAMIC_DRAW);
+  }
+
+  /* without the ring, the first pipelined frame uploads the start positions again */
+  particleStaging[0] = (float *)particlePositions;
+  particleStaging[1] = (float *)malloc(PARTICLE_COUNT * sizeof(vec4));
+
+  glEnableVertexAttribArray(vPosition);
+  glVertexAttribPointer(vPosition, 4, GL_FLOAT, GL_FALSE, 0, 0);
+
+  glBindVertexArray(0);
+
+  /* room for one item per chunk, the queue grows if needed */
+  render_queue_make(&renderQueue, NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM);
 }
 
 
@@ -1158,13 +2003,13 @@ void SetupDataBuffers() {
 *
 *******************************************************************/
 
-void AddShader(const char* ShaderCode, GLenum ShaderType) {
+GLuint CompileShader(const char* ShaderCode, GLenum ShaderType) {
   /* Create shader object */
   GLuint ShaderObj = glCreateShader(ShaderType);
 
   if (ShaderObj == 0) {
     fprintf(stderr, "Error creating shader type %d\n", ShaderType);
-    exit(0);
+    return 0;
   }
 
   /* Associate shader source code string with shader object */
@@ -1180,6 +2025,16 @@ void AddShader(const char* ShaderCode, GLenum ShaderType) {
   if (!success) {
     glGetShaderInfoLog(ShaderObj, 1024, NULL, InfoLog);
     fprintf(stderr, "Error compiling shader type %d: '%s'\n", ShaderType, InfoLog);
+    glDeleteShader(ShaderObj);
+    return 0;
+  }
+  return ShaderObj;
+}
+
+void AddShader(const char* ShaderCode, GLenum ShaderType) {
+  GLuint ShaderObj = CompileShader(ShaderCode, ShaderType);
+
+  if (ShaderObj == 0) {
     exit(1);
   }
 
@@ -1188,6 +2043,34 @@ void AddShader(const char* ShaderCode, GLenum ShaderType) {
 }
 
 
+/******************************************************************
+*
+* ResolveUniforms
+*
+* Looks up the location of every uniform used by the draw code once
+* after the shader program is linked and assigns the binding points
+* of the uniform blocks; Display only uses the handles
+*
+*******************************************************************/
+
+void ResolveUniforms() {
+  uniforms.PVM_Matrix = glGetUniformLocation(ShaderProgram, "PVM_Matrix");
+  uniforms.VM_Matrix = glGetUniformLocation(ShaderProgram, "VM_Matrix");
+  uniforms.NormalMatrix = glGetUniformLocation(ShaderProgram, "NormalMatrix");
+  uniforms.ProjectionMatrix = glGetUniformLocation(ShaderProgram, "ProjectionMatrix");
+  uniforms.ViewMatrix = glGetUniformLocation(ShaderProgram, "ViewMatrix");
+  uniforms.instancedRendering = glGetUniformLocation(ShaderProgram, "instancedRendering");
+  uniforms.ambientRendering = glGetUniformLocation(ShaderProgram, "ambientRendering");
+  uniforms.diffuseRendering = glGetUniformLocation(ShaderProgram, "diffuseRendering");
+  uniforms.specularRendering = glGetUniformLocation(ShaderProgram, "specularRendering");
+  uniforms.particleRendering = glGetUniformLocation(ShaderProgram, "particleRendering");
+
+  /* lights and materials come from uniform buffers */
+  glUniformBlockBinding(ShaderProgram, glGetUniformBlockIndex(ShaderProgram, "LightBlock"), LightBlockBinding);
+  glUniformBlockBinding(ShaderProgram, glGetUniformBlockIndex(ShaderProgram, "MaterialBlock"), MaterialBlockBinding);
+}
+
+
 /******************************************************************
 *
 * CreateShaderProgram
@@ -1242,6 +2125,94 @@ void CreateShaderProgram() {
 
   /* Put linked shader program into drawing pipeline */
   glUseProgram(ShaderProgram);
+
+  ResolveUniforms();
+}
+
+
+/******************************************************************
+*
+* CreateParticleSimulation
+*
+* Builds the transform feedback program of the GPU particle
+* simulation and its two sets of state buffers; on any error the
+* GPU path stays unavailable and the CPU simulates the particles
+*
+*******************************************************************/
+
+void CreateParticleSimulation() {
+  const char* SimulationShaderString = LoadShader("shaders/particlesimulation.vs");
+  GLuint ShaderObj = SimulationShaderString ? CompileShader(SimulationShaderString, GL_VERTEX_SHADER) : 0;
+
+  if (ShaderObj == 0) {
+    fprintf(stderr, "GPU particle simulation disabled\n");
+    return;
+  }
+
+  /* capture the new state into two separate buffers */
+  GLuint program = glCreateProgram();
+  const GLchar* varyings[] = { "outPosition", "outVelocity" };
+  glAttachShader(program, ShaderObj);
+  glTransformFeedbackVaryings(program, 2, varyings, GL_SEPARATE_ATTRIBS);
+  glLinkProgram(program);
+  glDeleteShader(ShaderObj);
+
+  GLint Success = 0;
+  GLchar ErrorLog[1024];
+  glGetProgramiv(program, GL_LINK_STATUS, &Success);
+
+  if (Success == 0) {
+    glGetProgramInfoLog(program, sizeof(ErrorLog), NULL, ErrorLog);
+    fprintf(stderr, "Error linking particle simulation: '%s', GPU particle simulation disabled\n", ErrorLog);
+    glDeleteProgram(program);
+    return;
+  }
+
+  particleSimulationProgram = program;
+  particleSimulationUniforms.delta = glGetUniformLocation(program, "delta");
+  particleSimulationUniforms.attractors = glGetUniformLocation(program, "attractors");
+  particleSimulationUniforms.attractorCount = glGetUniformLocation(program, "attractorCount");
+
+  glGenBuffers(4, &(particleStateBuffers[0][0]));
+  glGenVertexArrays(2, particleSimulationVAO);
+  glGenVertexArrays(2, particleDrawVAO);
+
+  for (int set = 0; set < 2; set++) {
+    for (int k = 0; k < 2; k++) {
+      glBindBuffer(GL_ARRAY_BUFFER, particleStateBuffers[set][k]);
+      glBufferData(GL_ARRAY_BUFFER, PARTICLE_COUNT * sizeof(vec4), NULL, GL_DYNAMIC_COPY);
+    }
+
+    /* the simulation reads position and velocity, drawing only the position */
+    glBindVertexArray(particleSimulationVAO[set]);
+    for (int k = 0; k < 2; k++) {
+      glBindBuffer(GL_ARRAY_BUFFER, particleStateBuffers[set][k]);
+      glEnableVertexAttribArray(k);
+      glVertexAttribPointer(k, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    }
+
+    glBindVertexArray(particleDrawVAO[set]);
+    glBindBuffer(GL_ARRAY_BUFFER, particleStateBuffers[set][0]);
+    glEnableVertexAttribArray(vPosition);
+    glVertexAttribPointer(vPosition, 4, GL_FLOAT, GL_FALSE, 0, 0);
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+/******************************************************************
+*
+* ParseMeshTask
+*
+* Worker pool task loading one distinct OBJ file, from its binary
+* cache if that is up to date
+*
+*******************************************************************/
+
+void ParseMeshTask(void *argument) {
+  MeshLoadJob *job = (MeshLoadJob*) argument;
+  job->success = load_cached_obj_mesh(&(job->mesh), (char*) job->filename, MESH_LOAD_FLAGS);
 }
 
 
@@ -1249,128 +2220,232 @@ void CreateShaderProgram() {
 *
 * LoadObjFiles
 *
-* This function is called to load the different object files
+* This function is called to load the different object files; every
+* distinct file is parsed once on the worker pool, objects using the
+* same file share its mesh. Parsing runs in the background until
+* WaitForObjFiles is called.
 *
 *******************************************************************/
 
 void LoadObjFiles() {
+  const char* objectFiles[NUM_STATIC + NUM_BASIC_ANIM + NUM_ADV_ANIM];
   int objIndex = 0;
-  int success;
 
   /* Load all models, don't forget to update the macros if you add/remove some
    * Load all static models */
-
-  char* filename = "models/pillars.obj"; 
-  success = parse_obj_scene(&(data[objIndex]), filename);
+  objectFiles[objIndex] = "models/pillars.obj";
   InitialTransform[objIndex] = translate(mat4(1.0f), vec3(0.0f, 0.0f, 0.0f));
-
   objIndex += 1;
-  if(!success) {
-    printf("Could not load file. Exiting.\n");
-  }
 
-  filename = "models/floor_static.obj"; 
-  success = parse_obj_scene(&(data[objIndex]), filename);
+  objectFiles[objIndex] = "models/floor_static.obj";
   InitialTransform[objIndex] = translate(mat4(1.0f), vec3(0.0f, 0.0f, 0.0f));
-
   objIndex += 1;
-  if(!success) {
-    printf("Could not load file. Exiting.\n");
-  }
 
-  filename = "models/roof.obj"; 
-  success = parse_obj_scene(&(data[objIndex]), filename);
+  objectFiles[objIndex] = "models/roof.obj";
   InitialTransform[objIndex] = translate(mat4(1.0f), vec3(0.0f, 0.0f, 0.0f));
-
   objIndex += 1;
-  if(!success) {
-    printf("Could not load file. Exiting.\n");
-  }
 
-  filename = "models/dragonHead.obj"; 
-  success = parse_obj_scene(&(data[objIndex]), filename);
+  objectFiles[objIndex] = "models/dragonHead.obj";
   InitialTransform[objIndex] = translate(mat4(1.0f), vec3(0.0f, 0.0f, 0.0f));
-
   objIndex += 1;
-  if(!success) {
-    printf("Could not load file. Exiting.\n");
-  }
 
   /* Load all Basic animation models */
-  filename = "models/floor_rotating.obj"; 
-  success = parse_obj_scene(&(data[objIndex]), filename);
+  objectFiles[objIndex] = "models/floor_rotating.obj";
   InitialTransform[objIndex] = translate(mat4(1.0f), vec3(0.0f, 0.0f, 0.0f));
-
   objIndex += 1;
-  if(!success) {
-    printf("Could not load file. Exiting.\n");
-  }
 
   /* Load all Advanced animation models */
-  for (int i = 0; i < 6; i++) {
-    filename = "models/myLittleDragon.obj"; 
-    success = parse_obj_scene(&(data[objIndex]), filename);
-    InitialTransform[objIndex] = rotate(mat4(1.0f), radians(float(60*i)), vec3(0.0f,1.0f,0.0f));
+  for (int i = 0; i < NUM_ADV_ANIM; i++) {
+    objectFiles[objIndex] = "models/myLittleDragon.obj";
+    InitialTransform[objIndex] = rotate(mat4(1.0f), radians(360.0f*i/NUM_ADV_ANIM), vec3(0.0f,1.0f,0.0f));
     InitialTransform[objIndex] = translate(InitialTransform[objIndex], vec3(-4.0f, 0.6f, 0.0f));
     InitialTransform[objIndex] = scale(InitialTransform[objIndex], vec3(0.4f, 0.4f, 0.4f));
-
     objIndex += 1;
-    if(!success) {
-      printf("Could not load file. Exiting.\n");
+  }
+
+  /* objects start where they are placed, static ones stay there */
+  for (int i = 0; i < objIndex; i++) {
+    ModelMatrix[i] = InitialTransform[i];
+  }
+
+  /* Queue every distinct file once */
+  meshLoadJobCount = 0;
+  for (int i = 0; i < objIndex; i++) {
+    int job = 0;
+    while (job < meshLoadJobCount && strcmp(meshLoadJobs[job].filename, objectFiles[i]) != 0) {
+      job++;
+    }
+
+    if (job == meshLoadJobCount) {
+      meshLoadJobs[job].filename = objectFiles[i];
+      meshLoadJobCount++;
+      thread_pool_add_task(&workerPool, ParseMeshTask, &(meshLoadJobs[job]));
     }
+    objectMeshJob[i] = job;
   }
+}
+
+
+/******************************************************************
+*
+* ReportMeshStats
+*
+* Prints the post transform cache efficiency of a loaded mesh:
+* ACMR (vertex shader runs per triangle) and ATVR (runs per vertex,
+* 1.0 is optimal), simulated with a FIFO cache per chunk
+*
+*******************************************************************/
 
-  /*  Copy mesh data from structs into appropriate arrays */ 
-  objIndex = 0;
-  int vert = 0;
-  int indx = 0;
-  int nrml = 0;
-  int texv = 0;
+void ReportMeshStats(const char* filename, obj_mesh* mesh) {
+  int misses = 0;
 
-  for (int z = 0; z < NUM_STATIC + NUM_BASIC_ANIM + NUM_ADV_ANIM; z++) {
-    vert = data[z].vertex_count;
-    indx = data[z].face_count;
-    nrml = data[z].vertex_normal_count;
-    texv = data[z].vertex_texture_count;
+  for (int c = 0; c < mesh->chunk_count; c++) {
+    mesh_chunk *chunk = &(mesh->chunks[c]);
+    misses += mesh_vertex_cache_misses((char*)mesh->indices + chunk->first_index*mesh->index_size, mesh->index_size,
+                                       chunk->index_count, chunk->vertex_count, MESH_VERTEX_CACHE_SIZE);
+  }
+
+  printf("%s: %d triangles, %d vertices, %d bit indices, %d levels of detail, ACMR %.3f, ATVR %.3f\n", filename,
+         mesh->triangle_count, mesh->vertex_count, mesh->index_size*8, mesh->lod_count,
+         mesh->triangle_count > 0 ? (float)misses/mesh->triangle_count : 0.0f,
+         mesh->vertex_count > 0 ? (float)misses/mesh->vertex_count : 0.0f);
+}
 
-    vertex_buffer_data[z] = (GLfloat*) calloc (vert*3, sizeof(GLfloat));
-    index_buffer_data[z] = (GLushort*) calloc (indx*3, sizeof(GLushort));
-    normal_buffer_data[z] = (GLfloat*) calloc (nrml*3, sizeof(GLfloat));
-    material_index_buffer_data[z] = (GLushort*) calloc (indx, sizeof(GLushort));
-    texture_buffer_data[z] = (GLfloat*) calloc (texv*2, sizeof(GLfloat));
 
-    /* Vertices */
-    for(int i=0; i<vert; i++) {
-      vertex_buffer_data[z][i*3] = (GLfloat)(*(data[z]).vertex_list[i]).e[0];
-      vertex_buffer_data[z][i*3+1] = (GLfloat)(*(data[z]).vertex_list[i]).e[1];
-      vertex_buffer_data[z][i*3+2] = (GLfloat)(*(data[z]).vertex_list[i]).e[2];
-    }
+/******************************************************************
+*
+* BuildInstanceGroups
+*
+* Collects animated objects sharing a mesh into instance groups;
+* objects with a mesh of their own are drawn individually
+*
+*******************************************************************/
+
+void BuildInstanceGroups() {
+  int jobGroup[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM];
+  int jobObjects[NUM_STATIC+NUM_BASIC_ANIM+NUM_ADV_ANIM] = {0};
+
+  for (int i = NUM_STATIC; i < NUM_STATIC + NUM_BASIC_ANIM + NUM_ADV_ANIM; i++) {
+    jobObjects[objectMeshJob[i]]++;
+  }
 
-    /* Indices */
-    for(int i=0; i<indx; i++) {
-      index_buffer_data[z][i*3] = (GLushort)(*(data[z]).face_list[i]).vertex_index[0];
-      index_buffer_data[z][i*3+1] = (GLushort)(*(data[z]).face_list[i]).vertex_index[1];
-      index_buffer_data[z][i*3+2] = (GLushort)(*(data[z]).face_list[i]).vertex_index[2];
+  instanceGroupCount = 0;
+  for (int j = 0; j < meshLoadJobCount; j++) {
+    jobGroup[j] = -1;
+    if (jobObjects[j] > 1) {
+      jobGroup[j] = instanceGroupCount++;
+      instanceGroups[jobGroup[j]].objectCount = 0;
     }
+  }
+
+  for (int i = 0; i < NUM_STATIC + NUM_BASIC_ANIM + NUM_ADV_ANIM; i++) {
+    objectInstanceGroup[i] = i < NUM_STATIC ? -1 : jobGroup[objectMeshJob[i]];
 
-    /* Normals */
-    for(int i=0; i<nrml; i++) {
-      normal_buffer_data[z][i*3] = (GLfloat)(*(data[z]).vertex_normal_list[i]).e[0];
-      normal_buffer_data[z][i*3+1] = (GLfloat)(*(data[z]).vertex_normal_list[i]).e[1];
-      normal_buffer_data[z][i*3+2] = (GLfloat)(*(data[z]).vertex_normal_list[i]).e[2];
+    if (objectInstanceGroup[i] >= 0) {
+      InstanceGroup *group = &(instanceGroups[objectInstanceGroup[i]]);
+      group->objects[group->objectCount++] = i;
     }
+  }
+}
+
+
+/******************************************************************
+*
+* MergeStaticMeshes
+*
+* The static objects never move, so their meshes are transformed
+* into world space once and merged into staticMesh with per-vertex
+* material indices into the concatenated materials; objects with
+* levels of detail are merged with their full level, the single
+* draw saves more than their coarser levels would
+*
+*******************************************************************/
+
+void MergeStaticMeshes() {
+  float transforms[NUM_STATIC*16];
+  int materialCount = 0;
+
+  for (int i = 0; i < NUM_STATIC; i++) {
+    memcpy(transforms + i*16, value_ptr(InitialTransform[i]), 16*sizeof(float));
+    materialCount += meshes[i].material_count;
+  }
+
+  staticMerged = 0;
+  if (NUM_STATIC > 1 && materialCount <= MAX_SHADER_MATERIALS) {
+    staticMerged = merge_obj_meshes(&staticMesh, meshes, transforms, NUM_STATIC, MESH_LOAD_FLAGS);
+  }
+
+  for (int i = 0; i < NUM_STATIC + NUM_BASIC_ANIM + NUM_ADV_ANIM; i++) {
+    objectMerged[i] = staticMerged && i < NUM_STATIC;
+  }
+
+  if (staticMerged) {
+    ReportMeshStats("static objects merged", &staticMesh);
+  }
+}
+
 
-    /* Material indices */
-    for(int i=0; i<indx; i++) {
-      material_index_buffer_data[z][i] = (GLushort)(*(data[z]).face_list[i]).material_index;
+/******************************************************************
+*
+* BuildSceneBVH
+*
+* Builds the scene hierarchy from the world space bounds of the
+* objects: one subtree for the static objects and one for the
+* animated objects, joined under the root
+*
+*******************************************************************/
+
+void BuildSceneBVH() {
+  int staticObjects[NUM_STATIC];
+  int dynamicObjects[NUM_BASIC_ANIM+NUM_ADV_ANIM];
+
+  for (int i = 0; i < NUM_STATIC + NUM_BASIC_ANIM + NUM_ADV_ANIM; i++) {
+    frustum_transform_bounds(&(meshes[i].bounds), value_ptr(ModelMatrix[i]), &(objectBounds[i]));
+    if (i < NUM_STATIC) {
+      staticObjects[i] = i;
     }
+    else {
+      dynamicObjects[i - NUM_STATIC] = i;
+    }
+  }
+
+  bvh_make(&sceneBVH);
+  int staticSubtree = bvh_build(&sceneBVH, objectBounds, staticObjects, NUM_STATIC);
+  dynamicSubtree = bvh_build(&sceneBVH, objectBounds, dynamicObjects, NUM_BASIC_ANIM + NUM_ADV_ANIM);
+  sceneBVH.root = bvh_join(&sceneBVH, staticSubtree, dynamicSubtree);
+}
+
+
+/******************************************************************
+*
+* WaitForObjFiles
+*
+* Joins the parse tasks started by LoadObjFiles and hands the meshes
+* to the objects; must be called before the meshes are uploaded
+*
+*******************************************************************/
 
-    /* texture coordinates */
-    for (int i = 0; i < texv; i++) {
-      texture_buffer_data[z][i*2] = (GLfloat)(*(data[z]).vertex_texture_list[i]).t[0];
-      texture_buffer_data[z][i*2+1] = (GLfloat)(*(data[z]).vertex_texture_list[i]).t[1];
+void WaitForObjFiles() {
+  thread_pool_wait(&workerPool);
+
+  for (int i = 0; i < meshLoadJobCount; i++) {
+    if (!meshLoadJobs[i].success) {
+      printf("Could not load file %s. Exiting.\n", meshLoadJobs[i].filename);
+      exit(EXIT_FAILURE);
+    }
+    else {
+      ReportMeshStats(meshLoadJobs[i].filename, &(meshLoadJobs[i].mesh));
     }
   }
+
+  /* Objects loaded from the same file share the parsed arrays */
+  for (int i = 0; i < NUM_STATIC + NUM_BASIC_ANIM + NUM_ADV_ANIM; i++) {
+    meshes[i] = meshLoadJobs[objectMeshJob[i]].mesh;
+  }
+
+  MergeStaticMeshes();
+  BuildInstanceGroups();
+  BuildSceneBVH();
 }
 
 
@@ -1479,9 +2554,22 @@ int LoadJpegFiles (const char* filename, unsigned char* dest, const int format,
 *******************************************************************/
 
 void Initialize() {   
-  /* Load the object files */
+  /* Start the worker threads, one per core */
+  thread_pool_make(&workerPool, 0);
+
+  /* Start loading the object files in the background */
   LoadObjFiles();
 
+  /* Time the stages of the idle callback on the CPU and the render passes on the GPU */
+  profiler_make(&frameProfiler);
+  profileCulling = profiler_add_section(&frameProfiler, "culling", PROFILER_CPU);
+  profileMeshes = profiler_add_section(&frameProfiler, "meshes", PROFILER_GPU);
+  profileParticles = profiler_add_section(&frameProfiler, "particles", PROFILER_GPU);
+  profileParticleUpdate = profiler_add_section(&frameProfiler, "particle update", PROFILER_CPU);
+  profileParticleSimulation = profiler_add_section(&frameProfiler, "particle gpu step", PROFILER_GPU);
+  profileAnimation = profiler_add_section(&frameProfiler, "animation", PROFILER_CPU);
+  profileCamera = profiler_add_section(&frameProfiler, "camera", PROFILER_CPU);
+
   /* Set background (clear) color to soft bluegreen */ 
   glClearColor(0.0, 0.2, 0.4, 0.0);
 
@@ -1493,17 +2581,21 @@ void Initialize() {
   glEnable(GL_DEPTH_TEST);
   glDepthFunc(GL_LESS);    
 
+  /* Wait for the object files before uploading them */
+  WaitForObjFiles();
+
   /* Setup vertex and (material) index buffer objects */
   SetupDataBuffers();
 
   /* Setup shaders and shader program */
   CreateShaderProgram();  
+  CreateParticleSimulation();
 
   /* Set projection transform */
   float fovy = 45.0;
   float aspect = 1.0; 
   float nearPlane = 1.0; 
-  float farPlane = 50.0;
+  float farPlane = FAR_PLANE;
   ProjectionMatrix = perspective(fovy, aspect, nearPlane, farPlane);
 
   /* Set camera transform */
@@ -1555,10 +2647,6 @@ void Initialize() {
   lights[2].attenuation = .2f;
   lights[2].intensity = .1f;
 
-  //set the number of lights in shader
-  GLuint light_count = glGetUniformLocation(ShaderProgram, "light_count");
-  glUniform1i(light_count, NUM_LIGHT);
-
   //Set initial attractor positions and masses
   for (int i = 0; i < MAX_ATTRACTORS; i++) {
     attractor_masses[i] = 0.5f + random_float() * 0.5f;
@@ -1567,33 +2655,16 @@ void Initialize() {
     attractors[i] = vec4(0, 2, 0, attractor_masses[i]);
   }
 
-  //initialize light attribute strings for shader access
-  lightAttributes[0][0] = '\0';
-  lightAttributes[1][0] = '\0';
-  lightAttributes[2][0] = '\0';
-  lightAttributes[3][0] = '\0';
-  lightAttributes[4][0] = '\0';
-  lightAttributes[5][0] = '\0';
-  lightAttributes[6][0] = '\0';
-  lightAttributes[7][0] = '\0';
-  lightAttributes[8][0] = '\0';
-  strcat(lightAttributes[0], "lights[0].isEnabled\0");
-  strcat(lightAttributes[1], "lights[0].type\0");
-  strcat(lightAttributes[2], "lights[0].ambient\0");
-  strcat(lightAttributes[3], "lights[0].color\0");
-  strcat(lightAttributes[4], "lights[0].position\0");
-  strcat(lightAttributes[5], "lights[0].coneDirection\0");
-  strcat(lightAttributes[6], "lights[0].coneCutOffAngleCos\0");
-  strcat(lightAttributes[7], "lights[0].attenuation\0");
-  strcat(lightAttributes[8], "lights[0].intensity\0");
-
-  //initialize the material attribute strings for shader access
-  materialAttributes[0][0] = '\0';
-  materialAttributes[1][0] = '\0';
-  materialAttributes[2][0] = '\0';
-  strcat(materialAttributes[0], "materials[0].ambient\0");
-  strcat(materialAttributes[1], "materials[0].diffuse\0");
-  strcat(materialAttributes[2], "materials[0].specular\0");
+  /* use the widest particle kernel the CPU supports, checked against the scalar one */
+  const char *kernelName;
+  particleKernel = particle_select_kernel(&kernelName);
+  float deviation = particle_kernel_deviation(particleKernel, &particles, particles.count < 4096 ? particles.count : 4096,
+                                              value_ptr(attractors[0]), MAX_ATTRACTORS, 0.1f, 100);
+  printf("Particle kernel: %s, deviation from scalar %g\n", kernelName, deviation);
+  if (deviation > 1e-3f) {
+    particleKernel = particle_update_scalar;
+    printf("Particle kernel: falling back to scalar\n");
+  }
 }
 
 
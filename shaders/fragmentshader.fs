@@ -31,12 +31,15 @@ struct Light {
 	float intensity; //light intensity between 0 and 1
 };
 
-//actual number of lights in the lights array
-uniform int light_count;
 // maximum number of lights to be rendered per shader invocation
 const int MAX_LIGHTS = 10; 
-// the array of lights
-uniform Light lights[MAX_LIGHTS];
+// the lights, updated once per frame; mirrored by LightBlock in MerryGoRound.cpp
+layout (std140) uniform LightBlock {
+	// the array of lights
+	Light lights[MAX_LIGHTS];
+	//actual number of lights in the lights array
+	int light_count;
+};
 
 //structure for material properties
 struct Material {
@@ -45,12 +48,15 @@ struct Material {
     vec3 specular;
 };
 
-//actual number of materials in the materials array
-uniform int material_count;
 //maximum number of materials in the materials array
 const int MAX_MATERIALS = 10;
-//the array of materials
-uniform Material materials[MAX_MATERIALS];
+//the materials of the current mesh, one buffer per mesh; mirrored by MaterialBlock in MerryGoRound.cpp
+layout (std140) uniform MaterialBlock {
+	//the array of materials
+	Material materials[MAX_MATERIALS];
+	//actual number of materials in the materials array
+	int material_count;
+};
 
 //flags to turn on/off parts of the calculations
 uniform int ambientRendering;
@@ -0,0 +1,58 @@
+/******************************************************************
+*
+* particlesimulation.vs
+*
+* One step of the particle simulation on the GPU. Every vertex is a
+* particle; the new state is captured with transform feedback into
+* the other pair of buffers, nothing is rasterized. Does the same
+* as particle_update_scalar in source/Particles.cpp.
+*
+* Computer Graphics Proseminar SS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*
+*******************************************************************/
+
+
+#version 330 core
+
+#define MAX_ATTRACTORS 8
+
+uniform float delta;
+uniform vec4 attractors[MAX_ATTRACTORS]; //position and mass
+uniform int attractorCount;
+
+layout (location = 0) in vec4 vPosition; //w is the remaining life
+layout (location = 1) in vec4 vVelocity;
+
+out vec4 outPosition;
+out vec4 outVelocity;
+
+void main()
+{
+    vec4 position = vPosition;
+    vec3 velocity = vVelocity.xyz;
+
+    position.xyz += velocity * delta;
+    position.w -= 0.0001 * delta;
+
+    for(int i = 0; i < attractorCount; i++) {
+        vec3 d = attractors[i].xyz - position.xyz;
+        float distanceSquared = dot(d, d);
+        velocity += d * (delta * delta * attractors[i].w / ((distanceSquared + 10.0) * sqrt(distanceSquared)));
+    }
+
+    //respawn near the origin
+    if(position.w <= 0.0) {
+        position.xyz *= -0.01;
+        velocity *= 0.01;
+        position.w += 1.0;
+    }
+
+    outPosition = position;
+    outVelocity = vec4(velocity, 0.0);
+}
@@ -21,10 +21,16 @@ uniform mat4 PVM_Matrix;
 uniform mat4 VM_Matrix;
 uniform mat4 NormalMatrix;
 
+//instanced draws take the model matrix from the instance attribute instead of the matrices above
+uniform int instancedRendering;
+uniform mat4 ProjectionMatrix;
+uniform mat4 ViewMatrix;
+
 layout (location = 0) in vec4 vPosition;
 layout (location = 1) in vec3 vNormal;
 layout (location = 2) in int MaterialIndex;
 layout (location = 3) in vec2 texCoord;
+layout (location = 4) in mat4 InstanceMatrix; //one model matrix per instance, locations 4 to 7
 
 out vec4 Position;  //the non-projected position
 out vec3 Normal;
@@ -34,10 +40,19 @@ flat out int materialIndex;
 
 void main()
 {
-    gl_Position = PVM_Matrix*vec4(vPosition.x, vPosition.y, vPosition.z, 1.0);
-    Position = VM_Matrix*vec4(vPosition.x, vPosition.y, vPosition.z, 1.0);
-	vec4 n = normalize(NormalMatrix * vec4(vNormal, 1.0));
-    Normal = vec3(n.x, n.y, n.z);        
+    if(instancedRendering == 1) {
+        mat4 vm = ViewMatrix * InstanceMatrix;
+        gl_Position = ProjectionMatrix*vm*vec4(vPosition.x, vPosition.y, vPosition.z, 1.0);
+        Position = vm*vec4(vPosition.x, vPosition.y, vPosition.z, 1.0);
+        //instances are only rotated, translated and uniformly scaled
+        Normal = normalize(mat3(vm) * vNormal);
+    }
+    else {
+        gl_Position = PVM_Matrix*vec4(vPosition.x, vPosition.y, vPosition.z, 1.0);
+        Position = VM_Matrix*vec4(vPosition.x, vPosition.y, vPosition.z, 1.0);
+        vec4 n = normalize(NormalMatrix * vec4(vNormal, 1.0));
+        Normal = vec3(n.x, n.y, n.z);        
+    }
     materialIndex = MaterialIndex;
 	texcoord = texCoord;
 }
@@ -0,0 +1,376 @@
+/******************************************************************
+*
+* BVH.c
+*
+* Description: Bounding volume hierarchy build, refit and queries.
+*
+* Computer Graphics Proseminar SS 2015
+* 
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*******************************************************************/
+
+/* Standard includes */
+#include <stdlib.h>
+
+#include "BVH.hpp"
+
+
+void bvh_make(bvh *tree)
+{
+	tree->nodes = NULL;
+	tree->node_count = 0;
+	tree->capacity = 0;
+	tree->root = -1;
+}
+
+void bvh_clear(bvh *tree)
+{
+	tree->node_count = 0;
+	tree->root = -1;
+}
+
+void bvh_free(bvh *tree)
+{
+	free(tree->nodes);
+	bvh_make(tree);
+}
+
+// returns the index of a new node; indices stay valid, pointers do not
+int bvh_add_node(bvh *tree)
+{
+	if(tree->node_count == tree->capacity)
+	{
+		tree->capacity = tree->capacity > 0 ? tree->capacity * 2 : 16;
+		tree->nodes = (bvh_node*) realloc(tree->nodes, sizeof(bvh_node) * tree->capacity);
+	}
+
+	tree->nodes[tree->node_count].left = -1;
+	tree->nodes[tree->node_count].right = -1;
+	tree->nodes[tree->node_count].parent = -1;
+	tree->nodes[tree->node_count].object = -1;
+	return tree->node_count++;
+}
+
+void bvh_union_children(bvh *tree, int node)
+{
+	bvh_node *n = tree->nodes + node;
+	const bvh_node *left = tree->nodes + n->left;
+	const bvh_node *right = tree->nodes + n->right;
+	int k;
+
+	for(k=0; k<3; k++)
+	{
+		n->min[k] = left->min[k] < right->min[k] ? left->min[k] : right->min[k];
+		n->max[k] = left->max[k] > right->max[k] ? left->max[k] : right->max[k];
+	}
+}
+
+void bvh_set_leaf_box(bvh_node *n, const mesh_bounds *bounds)
+{
+	int k;
+
+	for(k=0; k<3; k++)
+	{
+		n->min[k] = bounds->min[k];
+		n->max[k] = bounds->max[k];
+	}
+}
+
+
+/******************************************************************
+*
+* bvh_build
+*
+* Builds a subtree over the objects (indices into object_bounds) and
+* returns its root, -1 for no objects. Each level splits at the
+* middle of the longest axis of the box centers, or in half when all
+* centers fall on one side. The objects array is reordered
+*
+*******************************************************************/
+
+int bvh_build(bvh *tree, const mesh_bounds *object_bounds, int *objects, int object_count)
+{
+	float low[3], high[3], split;
+	int node, left, right, axis, middle, i, k;
+
+	if(object_count <= 0)
+		return -1;
+
+	node = bvh_add_node(tree);
+	if(object_count == 1)
+	{
+		tree->nodes[node].object = objects[0];
+		bvh_set_leaf_box(tree->nodes + node, object_bounds + objects[0]);
+		return node;
+	}
+
+	for(k=0; k<3; k++)
+	{
+		low[k] = object_bounds[objects[0]].center[k];
+		high[k] = low[k];
+	}
+	for(i=1; i<object_count; i++)
+	{
+		for(k=0; k<3; k++)
+		{
+			float c = object_bounds[objects[i]].center[k];
+			if(c < low[k])
+				low[k] = c;
+			if(c > high[k])
+				high[k] = c;
+		}
+	}
+
+	axis = 0;
+	for(k=1; k<3; k++)
+	{
+		if(high[k] - low[k] > high[axis] - low[axis])
+			axis = k;
+	}
+	split = 0.5f * (low[axis] + high[axis]);
+
+	middle = 0;
+	for(i=0; i<object_count; i++)
+	{
+		if(object_bounds[objects[i]].center[axis] < split)
+		{
+			int swap = objects[i];
+			objects[i] = objects[middle];
+			objects[middle++] = swap;
+		}
+	}
+	if(middle == 0 || middle == object_count)
+		middle = object_count / 2;
+
+	// building the children may move the nodes array, so they are linked afterwards
+	left = bvh_build(tree, object_bounds, objects, middle);
+	right = bvh_build(tree, object_bounds, objects + middle, object_count - middle);
+	tree->nodes[node].left = left;
+	tree->nodes[node].right = right;
+	tree->nodes[left].parent = node;
+	tree->nodes[right].parent = node;
+	bvh_union_children(tree, node);
+	return node;
+}
+
+
+/******************************************************************
+*
+* bvh_join
+*
+* Puts two subtrees under a new common node and returns it; an empty
+* subtree (-1) returns the other one
+*
+*******************************************************************/
+
+int bvh_join(bvh *tree, int left, int right)
+{
+	int node;
+
+	if(left < 0)
+		return right;
+	if(right < 0)
+		return left;
+
+	node = bvh_add_node(tree);
+	tree->nodes[node].left = left;
+	tree->nodes[node].right = right;
+	tree->nodes[left].parent = node;
+	tree->nodes[right].parent = node;
+	bvh_union_children(tree, node);
+	return node;
+}
+
+
+/******************************************************************
+*
+* bvh_refit
+*
+* Updates the boxes of a subtree from the current object bounds
+* without changing its shape, then the boxes on the path up to the
+* root; the rest of the tree is untouched. Cheap enough for every
+* frame as long as the objects do not move far relative to each
+* other
+*
+*******************************************************************/
+
+void bvh_refit_subtree(bvh *tree, int node, const mesh_bounds *object_bounds)
+{
+	if(tree->nodes[node].object >= 0)
+	{
+		bvh_set_leaf_box(tree->nodes + node, object_bounds + tree->nodes[node].object);
+		return;
+	}
+
+	bvh_refit_subtree(tree, tree->nodes[node].left, object_bounds);
+	bvh_refit_subtree(tree, tree->nodes[node].right, object_bounds);
+	bvh_union_children(tree, node);
+}
+
+void bvh_refit(bvh *tree, int node, const mesh_bounds *object_bounds)
+{
+	if(node < 0)
+		return;
+
+	bvh_refit_subtree(tree, node, object_bounds);
+	for(node = tree->nodes[node].parent; node >= 0; node = tree->nodes[node].parent)
+		bvh_union_children(tree, node);
+}
+
+
+int bvh_collect_objects(const bvh *tree, int node, int *objects_out, int count)
+{
+	const bvh_node *n = tree->nodes + node;
+
+	if(n->object >= 0)
+	{
+		objects_out[count] = n->object;
+		return count + 1;
+	}
+
+	count = bvh_collect_objects(tree, n->left, objects_out, count);
+	return bvh_collect_objects(tree, n->right, objects_out, count);
+}
+
+int bvh_query_node(const bvh *tree, int node, const frustum_planes *f, int *objects_out, int count)
+{
+	const bvh_node *n = tree->nodes + node;
+
+	switch(frustum_classify_box(f, n->min, n->max))
+	{
+		case FRUSTUM_OUTSIDE:
+			return count;
+		case FRUSTUM_INSIDE:
+			return bvh_collect_objects(tree, node, objects_out, count);
+	}
+
+	if(n->object >= 0)
+	{
+		objects_out[count] = n->object;
+		return count + 1;
+	}
+
+	count = bvh_query_node(tree, n->left, f, objects_out, count);
+	return bvh_query_node(tree, n->right, f, objects_out, count);
+}
+
+
+/******************************************************************
+*
+* bvh_query_frustum
+*
+* Writes the objects whose boxes touch the frustum to objects_out
+* and returns their number; subtrees completely inside are taken
+* without testing their nodes
+*
+*******************************************************************/
+
+int bvh_query_frustum(const bvh *tree, const frustum_planes *f, int *objects_out)
+{
+	if(tree->root < 0)
+		return 0;
+
+	return bvh_query_node(tree, tree->root, f, objects_out, 0);
+}
+
+
+// ray parameter where the ray enters the box, -1 if it misses it or enters beyond t_max
+float bvh_ray_box(const bvh_node *n, const float *origin, const float *inverse_direction, float t_max)
+{
+	float t_near = 0.0f, t_far = t_max;
+	int k;
+
+	for(k=0; k<3; k++)
+	{
+		float t0 = (n->min[k] - origin[k]) * inverse_direction[k];
+		float t1 = (n->max[k] - origin[k]) * inverse_direction[k];
+
+		if(t0 > t1)
+		{
+			float swap = t0;
+			t0 = t1;
+			t1 = swap;
+		}
+		if(t0 > t_near)
+			t_near = t0;
+		if(t1 < t_far)
+			t_far = t1;
+		if(t_near > t_far)
+			return -1.0f;
+	}
+	return t_near;
+}
+
+void bvh_ray_node(const bvh *tree, int node, const float *origin, const float *direction, const float *inverse_direction,
+		bvh_ray_test test, void *data, float *nearest, int *nearest_object)
+{
+	const bvh_node *n = tree->nodes + node;
+	float t_left, t_right, t_max;
+	int first, second;
+
+	if(n->object >= 0)
+	{
+		float t = test(n->object, origin, direction, data);
+		if(t >= 0.0f && (*nearest < 0.0f || t < *nearest))
+		{
+			*nearest = t;
+			*nearest_object = n->object;
+		}
+		return;
+	}
+
+	// the nearer child first, its hit may rule out the other one
+	t_max = *nearest >= 0.0f ? *nearest : 1e30f;
+	t_left = bvh_ray_box(tree->nodes + n->left, origin, inverse_direction, t_max);
+	t_right = bvh_ray_box(tree->nodes + n->right, origin, inverse_direction, t_max);
+	first = n->left;
+	second = n->right;
+	if(t_right >= 0.0f && (t_left < 0.0f || t_right < t_left))
+	{
+		float swap = t_left;
+		t_left = t_right;
+		t_right = swap;
+		first = n->right;
+		second = n->left;
+	}
+
+	if(t_left >= 0.0f)
+		bvh_ray_node(tree, first, origin, direction, inverse_direction, test, data, nearest, nearest_object);
+	if(t_right >= 0.0f && (*nearest < 0.0f || t_right <= *nearest))
+		bvh_ray_node(tree, second, origin, direction, inverse_direction, test, data, nearest, nearest_object);
+}
+
+
+/******************************************************************
+*
+* bvh_intersect_ray
+*
+* Returns the object with the nearest hit along origin + t * direction
+* and its t, -1 if no object is hit. Boxes only select candidates,
+* the hit itself is decided by the test callback
+*
+*******************************************************************/
+
+int bvh_intersect_ray(const bvh *tree, const float *origin, const float *direction,
+		bvh_ray_test test, void *data, float *t_out)
+{
+	float inverse_direction[3];
+	float nearest = -1.0f;
+	int nearest_object = -1;
+	int k;
+
+	for(k=0; k<3; k++)
+		inverse_direction[k] = 1.0f / direction[k];
+
+	if(tree->root < 0 || bvh_ray_box(tree->nodes + tree->root, origin, inverse_direction, 1e30f) < 0.0f)
+		return -1;
+
+	bvh_ray_node(tree, tree->root, origin, direction, inverse_direction, test, data, &nearest, &nearest_object);
+	if(t_out != NULL)
+		*t_out = nearest;
+	return nearest_object;
+}
@@ -0,0 +1,60 @@
+/******************************************************************
+*
+* BVH.h
+*
+* Description: Bounding volume hierarchy over the scene objects.
+*              Subtrees are built top-down over the world space
+*              boxes of a set of objects and joined under a common
+*              root; a subtree whose objects move keeps its shape
+*              and only has its boxes refitted each frame. Queries
+*              return the objects inside a view frustum or the
+*              object nearest along a ray.
+*
+* Computer Graphics Proseminar SS 2015
+* 
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*******************************************************************/
+
+#ifndef __BVH_H__
+#define __BVH_H__
+
+#include "Mesh.hpp"
+#include "Frustum.hpp"
+
+typedef struct
+{
+	float min[3];
+	float max[3];
+	int left;	//child nodes, -1 for a leaf
+	int right;
+	int parent;	//-1 for the root of the tree or of a subtree not joined yet
+	int object;	//object of a leaf, -1 for inner nodes
+} bvh_node;
+
+typedef struct
+{
+	bvh_node *nodes;
+	int node_count;
+	int capacity;
+	int root;	//-1 while empty
+} bvh;
+
+/* Exact hit test of a leaf object: t along the ray, -1 for a miss */
+typedef float (*bvh_ray_test)(int object, const float *origin, const float *direction, void *data);
+
+void bvh_make(bvh *tree);
+void bvh_clear(bvh *tree);
+int bvh_build(bvh *tree, const mesh_bounds *object_bounds, int *objects, int object_count);
+int bvh_join(bvh *tree, int left, int right);
+void bvh_refit(bvh *tree, int node, const mesh_bounds *object_bounds);
+
+int bvh_query_frustum(const bvh *tree, const frustum_planes *f, int *objects_out);
+int bvh_intersect_ray(const bvh *tree, const float *origin, const float *direction,
+		bvh_ray_test test, void *data, float *t_out);
+void bvh_free(bvh *tree);
+
+#endif // __BVH_H__
@@ -0,0 +1,280 @@
+/******************************************************************
+*
+* Frustum.c
+*
+* Description: View frustum extraction and bounding volume tests.
+*
+* Computer Graphics Proseminar SS 2015
+* 
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*******************************************************************/
+
+/* Standard includes */
+#include <math.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "Frustum.hpp"
+
+
+/******************************************************************
+*
+* frustum_from_matrix
+*
+* Extracts the clip planes of a column major projection * view
+* matrix (Gribb/Hartmann): each plane is the fourth row plus or
+* minus one of the first three rows. The planes are normalized so
+* that sphere tests can compare distances with the radius
+*
+*******************************************************************/
+
+void frustum_from_matrix(frustum_planes *frustum_out, const float *matrix)
+{
+	int i, k;
+
+	for(i=0; i<6; i++)
+	{
+		int row = i / 2;
+		float sign = (i & 1) ? -1.0f : 1.0f;
+		float plane[4], length;
+
+		// element (row r, column c) is matrix[c*4 + r]
+		for(k=0; k<4; k++)
+			plane[k] = matrix[k*4 + 3] + sign * matrix[k*4 + row];
+
+		length = sqrtf(plane[0]*plane[0] + plane[1]*plane[1] + plane[2]*plane[2]);
+		if(length > 0.0f)
+		{
+			for(k=0; k<4; k++)
+				plane[k] /= length;
+		}
+
+		frustum_out->a[i] = plane[0];
+		frustum_out->b[i] = plane[1];
+		frustum_out->c[i] = plane[2];
+		frustum_out->d[i] = plane[3];
+	}
+
+	for(i=6; i<FRUSTUM_PLANES; i++)
+	{
+		frustum_out->a[i] = 0.0f;
+		frustum_out->b[i] = 0.0f;
+		frustum_out->c[i] = 0.0f;
+		frustum_out->d[i] = 1.0f;
+	}
+}
+
+
+/******************************************************************
+*
+* frustum_transform_bounds
+*
+* Model space bounds to world space: the box is transformed with the
+* absolute values of the matrix (Arvo), the sphere radius is scaled
+* by the longest axis of the matrix
+*
+*******************************************************************/
+
+void frustum_transform_bounds(const mesh_bounds *bounds, const float *matrix, mesh_bounds *bounds_out)
+{
+	float half[3], scale = 0.0f;
+	int r, c;
+
+	for(r=0; r<3; r++)
+		half[r] = 0.5f * (bounds->max[r] - bounds->min[r]);
+
+	for(c=0; c<3; c++)
+	{
+		float axis = matrix[c*4]*matrix[c*4] + matrix[c*4+1]*matrix[c*4+1] + matrix[c*4+2]*matrix[c*4+2];
+		if(axis > scale)
+			scale = axis;
+	}
+
+	for(r=0; r<3; r++)
+	{
+		float center = matrix[12 + r];
+		float extent = 0.0f;
+
+		for(c=0; c<3; c++)
+		{
+			center += matrix[c*4 + r] * bounds->center[c];
+			extent += fabsf(matrix[c*4 + r]) * half[c];
+		}
+
+		bounds_out->center[r] = center;
+		bounds_out->min[r] = center - extent;
+		bounds_out->max[r] = center + extent;
+	}
+	bounds_out->radius = bounds->radius * sqrtf(scale);
+}
+
+
+/******************************************************************
+*
+* frustum_test_sphere
+*
+* Returns 0 if the sphere lies completely outside one of the planes
+*
+*******************************************************************/
+
+int frustum_test_sphere(const frustum_planes *f, const float *center, float radius)
+{
+#ifdef __SSE__
+	__m128 x = _mm_set1_ps(center[0]);
+	__m128 y = _mm_set1_ps(center[1]);
+	__m128 z = _mm_set1_ps(center[2]);
+	__m128 r = _mm_set1_ps(-radius);
+	int outside = 0;
+	int i;
+
+	for(i=0; i<FRUSTUM_PLANES; i+=4)
+	{
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(f->a + i), x),
+				_mm_mul_ps(_mm_loadu_ps(f->b + i), y)),
+				_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(f->c + i), z), _mm_loadu_ps(f->d + i)));
+		outside |= _mm_movemask_ps(_mm_cmplt_ps(distance, r));
+	}
+	return outside == 0;
+#else
+	int i;
+
+	for(i=0; i<6; i++)
+	{
+		if(f->a[i]*center[0] + f->b[i]*center[1] + f->c[i]*center[2] + f->d[i] < -radius)
+			return 0;
+	}
+	return 1;
+#endif
+}
+
+
+/******************************************************************
+*
+* frustum_test_box
+*
+* Returns 0 if the axis aligned box lies completely outside one of
+* the planes, tested with the corner farthest along the plane normal
+*
+*******************************************************************/
+
+int frustum_test_box(const frustum_planes *f, const float *min, const float *max)
+{
+#ifdef __SSE__
+	__m128 zero = _mm_setzero_ps();
+	__m128 min_x = _mm_set1_ps(min[0]), max_x = _mm_set1_ps(max[0]);
+	__m128 min_y = _mm_set1_ps(min[1]), max_y = _mm_set1_ps(max[1]);
+	__m128 min_z = _mm_set1_ps(min[2]), max_z = _mm_set1_ps(max[2]);
+	int outside = 0;
+	int i;
+
+	for(i=0; i<FRUSTUM_PLANES; i+=4)
+	{
+		__m128 a = _mm_loadu_ps(f->a + i);
+		__m128 b = _mm_loadu_ps(f->b + i);
+		__m128 c = _mm_loadu_ps(f->c + i);
+		__m128 x, y, z, distance;
+
+		// pick max where the normal component is positive, min elsewhere
+		x = _mm_max_ps(_mm_mul_ps(a, min_x), _mm_mul_ps(a, max_x));
+		y = _mm_max_ps(_mm_mul_ps(b, min_y), _mm_mul_ps(b, max_y));
+		z = _mm_max_ps(_mm_mul_ps(c, min_z), _mm_mul_ps(c, max_z));
+		distance = _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, _mm_loadu_ps(f->d + i)));
+		outside |= _mm_movemask_ps(_mm_cmplt_ps(distance, zero));
+	}
+	return outside == 0;
+#else
+	int i;
+
+	for(i=0; i<6; i++)
+	{
+		float x = f->a[i] > 0.0f ? max[0] : min[0];
+		float y = f->b[i] > 0.0f ? max[1] : min[1];
+		float z = f->c[i] > 0.0f ? max[2] : min[2];
+
+		if(f->a[i]*x + f->b[i]*y + f->c[i]*z + f->d[i] < 0.0f)
+			return 0;
+	}
+	return 1;
+#endif
+}
+
+
+/******************************************************************
+*
+* frustum_classify_box
+*
+* Like frustum_test_box, but also reports boxes completely inside,
+* i.e. whose nearest corner lies inside every plane; hierarchies
+* skip the tests below such a box
+*
+*******************************************************************/
+
+int frustum_classify_box(const frustum_planes *f, const float *min, const float *max)
+{
+#ifdef __SSE__
+	__m128 zero = _mm_setzero_ps();
+	__m128 min_x = _mm_set1_ps(min[0]), max_x = _mm_set1_ps(max[0]);
+	__m128 min_y = _mm_set1_ps(min[1]), max_y = _mm_set1_ps(max[1]);
+	__m128 min_z = _mm_set1_ps(min[2]), max_z = _mm_set1_ps(max[2]);
+	int outside = 0, crossing = 0;
+	int i;
+
+	for(i=0; i<FRUSTUM_PLANES; i+=4)
+	{
+		__m128 a = _mm_loadu_ps(f->a + i);
+		__m128 b = _mm_loadu_ps(f->b + i);
+		__m128 c = _mm_loadu_ps(f->c + i);
+		__m128 d = _mm_loadu_ps(f->d + i);
+		__m128 ax0 = _mm_mul_ps(a, min_x), ax1 = _mm_mul_ps(a, max_x);
+		__m128 by0 = _mm_mul_ps(b, min_y), by1 = _mm_mul_ps(b, max_y);
+		__m128 cz0 = _mm_mul_ps(c, min_z), cz1 = _mm_mul_ps(c, max_z);
+		__m128 far_distance, near_distance;
+
+		far_distance = _mm_add_ps(_mm_add_ps(_mm_max_ps(ax0, ax1), _mm_max_ps(by0, by1)), _mm_add_ps(_mm_max_ps(cz0, cz1), d));
+		near_distance = _mm_add_ps(_mm_add_ps(_mm_min_ps(ax0, ax1), _mm_min_ps(by0, by1)), _mm_add_ps(_mm_min_ps(cz0, cz1), d));
+		outside |= _mm_movemask_ps(_mm_cmplt_ps(far_distance, zero));
+		crossing |= _mm_movemask_ps(_mm_cmplt_ps(near_distance, zero));
+	}
+
+	if(outside)
+		return FRUSTUM_OUTSIDE;
+	return crossing ? FRUSTUM_INTERSECT : FRUSTUM_INSIDE;
+#else
+	int result = FRUSTUM_INSIDE;
+	int i;
+
+	for(i=0; i<6; i++)
+	{
+		float far_x = f->a[i] > 0.0f ? max[0] : min[0], near_x = f->a[i] > 0.0f ? min[0] : max[0];
+		float far_y = f->b[i] > 0.0f ? max[1] : min[1], near_y = f->b[i] > 0.0f ? min[1] : max[1];
+		float far_z = f->c[i] > 0.0f ? max[2] : min[2], near_z = f->c[i] > 0.0f ? min[2] : max[2];
+
+		if(f->a[i]*far_x + f->b[i]*far_y + f->c[i]*far_z + f->d[i] < 0.0f)
+			return FRUSTUM_OUTSIDE;
+		if(f->a[i]*near_x + f->b[i]*near_y + f->c[i]*near_z + f->d[i] < 0.0f)
+			result = FRUSTUM_INTERSECT;
+	}
+	return result;
+#endif
+}
+
+
+/******************************************************************
+*
+* frustum_test_bounds
+*
+* Cheap sphere test first, the tighter box test for the survivors
+*
+*******************************************************************/
+
+int frustum_test_bounds(const frustum_planes *f, const mesh_bounds *bounds)
+{
+	return frustum_test_sphere(f, bounds->center, bounds->radius) &&
+		frustum_test_box(f, bounds->min, bounds->max);
+}
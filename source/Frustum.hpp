@@ -0,0 +1,48 @@
+/******************************************************************
+*
+* Frustum.h
+*
+* Description: View frustum culling. The six planes are extracted
+*              from a combined projection * view matrix and kept in
+*              structure of arrays form, so one SSE instruction
+*              tests a bounding volume against four planes.
+*
+* Computer Graphics Proseminar SS 2015
+* 
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*******************************************************************/
+
+#ifndef __FRUSTUM_H__
+#define __FRUSTUM_H__
+
+#include "Mesh.hpp"
+
+#define FRUSTUM_PLANES 8	//six planes padded to two groups of four
+
+/* Results of frustum_classify_box */
+#define FRUSTUM_OUTSIDE 0
+#define FRUSTUM_INTERSECT 1
+#define FRUSTUM_INSIDE 2
+
+/* Planes a*x + b*y + c*z + d >= 0 inside, normalized; the padding planes accept everything */
+typedef struct
+{
+	float a[FRUSTUM_PLANES];
+	float b[FRUSTUM_PLANES];
+	float c[FRUSTUM_PLANES];
+	float d[FRUSTUM_PLANES];
+} frustum_planes;
+
+void frustum_from_matrix(frustum_planes *frustum_out, const float *matrix);
+void frustum_transform_bounds(const mesh_bounds *bounds, const float *matrix, mesh_bounds *bounds_out);
+
+int frustum_test_sphere(const frustum_planes *f, const float *center, float radius);
+int frustum_test_box(const frustum_planes *f, const float *min, const float *max);
+int frustum_classify_box(const frustum_planes *f, const float *min, const float *max);
+int frustum_test_bounds(const frustum_planes *f, const mesh_bounds *bounds);
+
+#endif // __FRUSTUM_H__
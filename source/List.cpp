@@ -20,6 +20,7 @@
 
 #include "List.hpp"
 
+#define LIST_NAME_BLOCK_SIZE 4096
 
 
 // internal helper functions
@@ -28,24 +29,95 @@ char list_is_full(list *listo)
 	return(listo->item_count == listo->current_max_size);
 }
 
-void list_grow(list *old_listo)
+int list_grow(list *listo)
+{
+	return list_reserve(listo, listo->current_max_size > 0 ? listo->current_max_size * 2 : 8);
+}
+
+unsigned int list_hash_name(const char *name)
+{
+	unsigned int hash = 2166136261u;
+
+	for(; *name != '\0'; name++)
+	{
+		hash ^= (unsigned char)*name;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// names are interned, so an equal name is the same pointer and only its first item is entered
+void list_name_table_insert(list *listo, int indx)
+{
+	unsigned int mask = listo->name_table_size - 1;
+	unsigned int slot = list_hash_name(listo->names[indx]) & mask;
+
+	while(listo->name_table[slot] != -1)
+	{
+		if(listo->names[listo->name_table[slot]] == listo->names[indx])
+			return;
+		slot = (slot + 1) & mask;
+	}
+	listo->name_table[slot] = indx;
+}
+
+// rebuilds the table for all named items, keeping it at most half full
+void list_name_table_rebuild(list *listo, int named_count)
 {
 	int i;
-	list new_listo;
-	
-	list_make(&new_listo, old_listo->current_max_size*2, old_listo->growable++);
-	
-	for(i=0; i<old_listo->current_max_size; i++)
-		list_add_item(&new_listo, old_listo->items[i] , old_listo->names[i]);
-	
-	list_free(old_listo);
-	
-	//copy new structure to old list
-	old_listo->names = new_listo.names;
-	old_listo->items = new_listo.items;
-	old_listo->item_count = new_listo.item_count;
-	old_listo->current_max_size = new_listo.current_max_size;
-	old_listo->growable = new_listo.growable;
+
+	if(listo->name_table_size < named_count * 2)
+	{
+		free(listo->name_table);
+		if(listo->name_table_size == 0)
+			listo->name_table_size = 16;
+		while(listo->name_table_size < named_count * 2)
+			listo->name_table_size *= 2;
+		listo->name_table = (int*) malloc(sizeof(int) * listo->name_table_size);
+	}
+
+	for(i=0; i<listo->name_table_size; i++)
+		listo->name_table[i] = -1;
+
+	for(i=0; i < listo->item_count; i++)
+	{
+		if(listo->names[i] != NULL)
+			list_name_table_insert(listo, i);
+	}
+
+	listo->name_table_dirty = 0;
+}
+
+// returns the stored copy of a name, adding it to the name arena if it is new; NULL if out of memory
+char* list_intern_name(list *listo, char *name)
+{
+	list_name_block *block = listo->name_blocks;
+	int indx = list_find(listo, name);
+	int length;
+	char *copy;
+
+	if(indx >= 0)
+		return listo->names[indx];
+
+	length = strlen(name) + 1;
+	if(block == NULL || block->used + length > block->size)
+	{
+		int size = length > LIST_NAME_BLOCK_SIZE ? length : LIST_NAME_BLOCK_SIZE;
+
+		block = (list_name_block*) malloc(sizeof(list_name_block) + size);
+		if(block == NULL)
+			return NULL;
+		block->next = listo->name_blocks;
+		block->used = 0;
+		block->size = size;
+		block->data = (char*)(block + 1);
+		listo->name_blocks = block;
+	}
+
+	copy = block->data + block->used;
+	memcpy(copy, name, length);
+	block->used += length;
+	return copy;
 }
 //end helpers
 
@@ -56,32 +128,62 @@ void list_make(list *listo, int start_size, char growable)
 	listo->item_count = 0;
 	listo->current_max_size = start_size;
 	listo->growable = growable;
+	listo->name_table = NULL;
+	listo->name_table_size = 0;
+	listo->name_table_dirty = 0;
+	listo->name_blocks = NULL;
+}
+
+// makes room for at least 'size' items, existing items and names are not copied;
+// returns 0 if out of memory, the list then keeps its items
+int list_reserve(list *listo, int size)
+{
+	char **names;
+	void **items;
+
+	if(size <= listo->current_max_size)
+		return 1;
+
+	names = (char**) realloc(listo->names, sizeof(char*) * size);
+	if(names == NULL)
+		return 0;
+	listo->names = names;
+
+	items = (void**) realloc(listo->items, sizeof(void*) * size);
+	if(items == NULL)
+		return 0;
+	listo->items = items;
+
+	listo->current_max_size = size;
+	return 1;
 }
 
 int list_add_item(list *listo, void *item, char *name)
 {
-	int name_length;
-	char *new_name;
-	
 	if( list_is_full(listo) )
 	{
-		if( listo->growable )
-			list_grow(listo);
-		else
+		if( !listo->growable || !list_grow(listo) )
 			return -1;
 	}
 	
 	listo->names[listo->item_count] = NULL;
 	if(name != NULL)
 	{
-		name_length = strlen(name);
-		new_name = (char*) malloc(sizeof(char) * name_length + 1);
-		strncpy(new_name, name, name_length);
-		listo->names[listo->item_count] = new_name;
+		listo->names[listo->item_count] = list_intern_name(listo, name);
+		if(listo->names[listo->item_count] == NULL)
+			return -1;
 	}
 
 	listo->items[listo->item_count] = item;
 	listo->item_count++;
+
+	if(name != NULL)
+	{
+		if(listo->name_table_dirty || listo->name_table_size < listo->item_count * 2)
+			list_name_table_rebuild(listo, listo->item_count);
+		else
+			list_name_table_insert(listo, listo->item_count-1);
+	}
 	
 	return listo->item_count-1;
 }
@@ -120,95 +222,154 @@ void* list_get_item(list *listo, void *item_to_find)
 
 void* list_get_name(list *listo, char *name_to_find)
 {
-	int i = 0;
+	int indx = list_find(listo, name_to_find);
 
-	for(i=0; i < listo->item_count; i++)
-	{
-		if(strncmp(listo->names[i], name_to_find, strlen(name_to_find)) == 0)
-			return listo->items[i];
-	}
-	
-	return NULL;
+	if(indx < 0)
+		return NULL;
+	return listo->items[indx];
 }
 
+// exact name match through the hash table, the first added item wins on duplicates
 int list_find(list *listo, char *name_to_find)
 {
-	int i = 0;
+	unsigned int mask;
+	unsigned int slot;
+	int indx;
 
-	for(i=0; i < listo->item_count; i++)
+	if(name_to_find == NULL || listo->name_table_size == 0)
+		return -1;
+
+	if(listo->name_table_dirty)
+		list_name_table_rebuild(listo, listo->item_count);
+
+	mask = listo->name_table_size - 1;
+	for(slot = list_hash_name(name_to_find) & mask; (indx = listo->name_table[slot]) != -1; slot = (slot + 1) & mask)
 	{
-		if(strncmp(listo->names[i], name_to_find, strlen(name_to_find)) == 0)
-			return i;
+		if(strcmp(listo->names[indx], name_to_find) == 0)
+			return indx;
 	}
 	
 	return -1;
 }
 
+// removes every occurrence of the item in one pass, keeping the order
 void list_delete_item(list *listo, void *item)
 {
 	int i;
+	int kept = 0;
 	
 	for(i=0; i < listo->item_count; i++)
 	{		
 		if( listo->items[i] == item )
-			list_delete_index(listo, i);
+			continue;
+
+		listo->names[kept] = listo->names[i];
+		listo->items[kept] = listo->items[i];
+		kept++;
+	}
+
+	if(kept != listo->item_count)
+	{
+		listo->item_count = kept;
+		listo->name_table_dirty = 1;
 	}
 }
 
+// removes every item with this name in one pass, keeping the order
 void list_delete_name(list *listo, char *name)
 {
 	int i;
-	//int j;
-	//char remove = 0;
-	
-	//	int length_name = strlen(name);
-	int item_name;
+	int kept = 0;
+	int indx = list_find(listo, name);
+	char *interned;
 	
-	if(name == NULL)
+	if(indx < 0)
 		return;
 	
+	interned = listo->names[indx];
 	for(i=0; i < listo->item_count; i++)
 	{
-		item_name = strlen(name);
-				
-		if( name != NULL && (strncmp(listo->names[i], name, strlen(name)) == 0) )
-			list_delete_index(listo, i);
+		if( listo->names[i] == interned )
+			continue;
+
+		listo->names[kept] = listo->names[i];
+		listo->items[kept] = listo->items[i];
+		kept++;
 	}
+
+	listo->item_count = kept;
+	listo->name_table_dirty = 1;
 }
 
 void list_delete_index(list *listo, int indx)
 {
-	int j;
-	
-	//remove item
-	if(listo->names[indx] != NULL)
-		free(listo->names[indx]);
-			
-	//restructure
-	for(j=indx; j < listo->item_count-1; j++)
-	{
-		listo->names[j] = listo->names[j+1];
-		listo->items[j] = listo->items[j+1];
-	}
-	
+	list_delete_range(listo, indx, 1);
+}
+
+// O(1) removal that moves the last item into the gap, does not keep the order
+void list_swap_delete_index(list *listo, int indx)
+{
+	if(indx < 0 || indx >= listo->item_count)
+		return;
+
 	listo->item_count--;
+	listo->names[indx] = listo->names[listo->item_count];
+	listo->items[indx] = listo->items[listo->item_count];
+	listo->name_table_dirty = 1;
+}
+
+// removes 'count' items starting at 'first' with a single move of the tail
+void list_delete_range(list *listo, int first, int count)
+{
+	if(first < 0 || count <= 0 || first >= listo->item_count)
+		return;
+
+	if(first + count > listo->item_count)
+		count = listo->item_count - first;
+
+	memmove(listo->names + first, listo->names + first + count, sizeof(char*) * (listo->item_count - first - count));
+	memmove(listo->items + first, listo->items + first + count, sizeof(void*) * (listo->item_count - first - count));
 	
-	return;
+	listo->item_count -= count;
+	listo->name_table_dirty = 1;
 }
 
 void list_delete_all(list *listo)
 {
-	int i;
-	
-	for(i=listo->item_count-1; i>=0; i--)
-		list_delete_index(listo, i);
+	listo->item_count = 0;
+	listo->name_table_dirty = 1;
 }
 
-void list_free(list *listo)
+// frees everything but the items array, which is returned to the caller
+void** list_detach_items(list *listo)
 {
-	list_delete_all(listo);
+	list_name_block *block = listo->name_blocks;
+	void **items = listo->items;
+
+	while(block != NULL)
+	{
+		list_name_block *next = block->next;
+		free(block);
+		block = next;
+	}
+
 	free(listo->names);
-	free(listo->items);
+	free(listo->name_table);
+
+	listo->items = NULL;
+	listo->names = NULL;
+	listo->name_table = NULL;
+	listo->name_table_size = 0;
+	listo->name_blocks = NULL;
+	listo->item_count = 0;
+	listo->current_max_size = 0;
+
+	return items;
+}
+
+void list_free(list *listo)
+{
+	free(list_detach_items(listo));
 }
 
 void list_print_list(list *listo)
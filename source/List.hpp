@@ -3,6 +3,10 @@
 * List.h
 *
 * Description: Code providing handling of lists.  
+*              Growable lists double their capacity with realloc;
+*              names are interned in a block arena owned by the list,
+*              so equal names share one copy and growing never copies
+*              a name.
 * Courtesy of http://www.kixor.net
 *
 * Computer Graphics Proseminar SS 2015
@@ -16,6 +20,14 @@
 #ifndef __LIST_H
 #define __LIST_H
 
+typedef struct list_name_block
+{
+	struct list_name_block *next;
+	int used;
+	int size;
+	char *data;
+} list_name_block;
+
 typedef struct
 {
 	int item_count;
@@ -24,9 +36,16 @@ typedef struct
 
 	void **items;
 	char **names;	
+
+	int *name_table;	//open addressing hash table of item indices by name, -1 marks a free slot
+	int name_table_size;	//power of two, 0 if no named item was added yet
+	char name_table_dirty;	//indices changed by a delete, rebuilt on the next lookup
+
+	list_name_block *name_blocks;	//storage of the interned names
 } list;
 
 void list_make(list *listo, int size, char growable);
+int list_reserve(list *listo, int size);
 int list_add_item(list *listo, void *item, char *name);
 char* list_print_items(list *listo);
 void* list_get_name(list *listo, char *name);
@@ -34,10 +53,13 @@ void* list_get_index(list *listo, int indx);
 void* list_get_item(list *listo, void *item_to_find);
 int list_find(list *listo, char *name_to_find);
 void list_delete_index(list *listo, int indx);
+void list_swap_delete_index(list *listo, int indx);
+void list_delete_range(list *listo, int first, int count);
 void list_delete_name(list *listo, char *name);
 void list_delete_item(list *listo, void *item);
 void list_delete_all(list *listo);
 void list_print_list(list *listo);
+void** list_detach_items(list *listo);
 void list_free(list *listo);
 
 void test_list();
@@ -0,0 +1,1192 @@
+/******************************************************************
+*
+* Mesh.c
+*
+* Description: Processing stages for triangle meshes after parsing.
+*
+* Computer Graphics Proseminar SS 2015
+* 
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*******************************************************************/
+
+/* Standard includes */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "Mesh.hpp"
+
+/* Scoring constants of Forsyth's linear-speed vertex cache optimisation */
+#define MESH_CACHE_DECAY_POWER 1.5f
+#define MESH_LAST_TRIANGLE_SCORE 0.75f
+#define MESH_VALENCE_BOOST_SCALE 2.0f
+#define MESH_VALENCE_BOOST_POWER 0.5f
+
+
+/******************************************************************
+*
+* mesh_triangle_area
+*
+* Twice the signed area of a triangle in the projection plane
+*
+*******************************************************************/
+
+float mesh_triangle_area(const float *a, const float *b, const float *c, int x, int y)
+{
+	return (b[x] - a[x]) * (c[y] - a[y]) - (b[y] - a[y]) * (c[x] - a[x]);
+}
+
+
+/******************************************************************
+*
+* mesh_triangulate_polygon
+*
+* Splits a polygon into corner_count-2 triangles by ear clipping in
+* the plane it is most parallel to, so concave polygons stay intact.
+* Writes 3 corner numbers (0..corner_count-1) per triangle to
+* triangles_out; work needs room for corner_count ints. Falls back
+* to a fan where no ear is found, e.g. for degenerate or self
+* intersecting polygons. Returns the number of triangles written
+*
+*******************************************************************/
+
+int mesh_triangulate_polygon(const float *positions, const int *position_indices, int corner_count,
+		int *triangles_out, int *work)
+{
+	float normal[3] = {0.0f, 0.0f, 0.0f};
+	float orientation;
+	int remaining = corner_count;
+	int triangle_count = 0;
+	int x, y, i, j;
+
+	if(corner_count < 3)
+		return 0;
+
+	for(i=0; i<corner_count; i++)
+	{
+		work[i] = i;
+		if(position_indices[i] < 0)
+			positions = NULL;
+	}
+
+	// Newell normal; its largest component picks the projection plane
+	for(i=0; positions != NULL && i<corner_count; i++)
+	{
+		const float *a = positions + position_indices[i] * 3;
+		const float *b = positions + position_indices[(i + 1) % corner_count] * 3;
+
+		normal[0] += (a[1] - b[1]) * (a[2] + b[2]);
+		normal[1] += (a[2] - b[2]) * (a[0] + b[0]);
+		normal[2] += (a[0] - b[0]) * (a[1] + b[1]);
+	}
+
+	// dropping the dominant axis d keeps the winding, the signed area there has the sign of normal[d]
+	i = fabsf(normal[0]) > fabsf(normal[1]) ? 0 : 1;
+	i = fabsf(normal[2]) > fabsf(normal[i]) ? 2 : i;
+	x = (i + 1) % 3;
+	y = (i + 2) % 3;
+	orientation = normal[i];
+
+	while(remaining > 3)
+	{
+		int ear = 0;
+
+		for(i=0; positions != NULL && i<remaining; i++)
+		{
+			const float *a = positions + position_indices[work[(i + remaining - 1) % remaining]] * 3;
+			const float *b = positions + position_indices[work[i]] * 3;
+			const float *c = positions + position_indices[work[(i + 1) % remaining]] * 3;
+			int inside = 0;
+
+			if(mesh_triangle_area(a, b, c, x, y) * orientation <= 0.0f)
+				continue;
+
+			for(j=0; j<remaining && !inside; j++)
+			{
+				const float *p = positions + position_indices[work[j]] * 3;
+
+				if(p == a || p == b || p == c)
+					continue;
+				inside = mesh_triangle_area(a, b, p, x, y) * orientation >= 0.0f &&
+					mesh_triangle_area(b, c, p, x, y) * orientation >= 0.0f &&
+					mesh_triangle_area(c, a, p, x, y) * orientation >= 0.0f;
+			}
+
+			if(!inside)
+			{
+				ear = i;
+				break;
+			}
+		}
+
+		// without positions or an ear this clips corner 0, i.e. a fan around the last corner
+		triangles_out[triangle_count*3] = work[(ear + remaining - 1) % remaining];
+		triangles_out[triangle_count*3+1] = work[ear];
+		triangles_out[triangle_count*3+2] = work[(ear + 1) % remaining];
+		triangle_count++;
+
+		remaining--;
+		memmove(work + ear, work + ear + 1, sizeof(int) * (remaining - ear));
+	}
+
+	triangles_out[triangle_count*3] = work[0];
+	triangles_out[triangle_count*3+1] = work[1];
+	triangles_out[triangle_count*3+2] = work[2];
+	return triangle_count + 1;
+}
+
+
+/******************************************************************
+*
+* mesh_hash_corner
+*
+* Mixes the four attribute indices of a corner into a table slot
+*
+*******************************************************************/
+
+unsigned int mesh_hash_corner(const mesh_corner *corner)
+{
+	unsigned int hash = (unsigned int)corner->position * 73856093u;
+
+	hash ^= (unsigned int)corner->texcoord * 19349663u;
+	hash ^= (unsigned int)corner->normal * 83492791u;
+	hash ^= (unsigned int)corner->material * 2654435761u;
+	return hash ^ (hash >> 16);
+}
+
+
+/******************************************************************
+*
+* mesh_weld
+*
+* Emits one interleaved vertex per distinct (v, vt, vn, material)
+* corner and an index per corner referring to it. vertices_out
+* needs room for corner_count vertices; returns the number of
+* vertices written or -1 if out of memory
+*
+*******************************************************************/
+
+int mesh_weld(const float *positions, const float *normals, const float *texcoords,
+		const mesh_corner *corners, int corner_count,
+		mesh_vertex *vertices_out, unsigned int *indices_out)
+{
+	unsigned int table_size = 16;
+	unsigned int mask, slot;
+	int *table;			//open addressing, first corner of each vertex, -1 marks a free slot
+	int vertex_count = 0;
+	int i;
+
+	while(table_size < (unsigned int)corner_count * 2)
+		table_size *= 2;
+	mask = table_size - 1;
+
+	table = (int*) malloc(sizeof(int) * table_size);
+	if(table == NULL)
+		return -1;
+	memset(table, 0xff, sizeof(int) * table_size);
+
+	for(i=0; i<corner_count; i++)
+	{
+		const mesh_corner *corner = corners + i;
+		mesh_vertex *vertex;
+		int found;
+
+		for(slot = mesh_hash_corner(corner) & mask; (found = table[slot]) != -1; slot = (slot + 1) & mask)
+		{
+			if(memcmp(corners + found, corner, sizeof(mesh_corner)) == 0)
+				break;
+		}
+
+		if(found != -1)
+		{
+			indices_out[i] = indices_out[found];
+			continue;
+		}
+
+		table[slot] = i;
+		vertex = vertices_out + vertex_count;
+		memset(vertex, 0, sizeof(mesh_vertex));
+
+		if(corner->position >= 0)
+			memcpy(vertex->position, positions + corner->position * 3, sizeof(vertex->position));
+		if(corner->normal >= 0)
+			memcpy(vertex->normal, normals + corner->normal * 3, sizeof(vertex->normal));
+		if(corner->texcoord >= 0)
+			memcpy(vertex->texcoord, texcoords + corner->texcoord * 2, sizeof(vertex->texcoord));
+		vertex->material_index = corner->material;
+
+		indices_out[i] = vertex_count++;
+	}
+
+	free(table);
+	return vertex_count;
+}
+
+
+/******************************************************************
+*
+* mesh_split
+*
+* Distributes the triangles in order over chunks referencing at
+* most max_vertices vertices each. The vertices of every chunk are
+* copied to a contiguous range of vertices_out (3 per triangle in
+* the worst case) and the indices are rewritten relative to it;
+* chunks_out needs room for one chunk per triangle. Returns the
+* number of chunks or -1 if out of memory
+*
+*******************************************************************/
+
+int mesh_split(const mesh_vertex *vertices, int vertex_count, unsigned int *indices, int triangle_count,
+		int max_vertices, mesh_vertex *vertices_out, mesh_chunk *chunks_out, int *vertex_count_out)
+{
+	int *chunk_of = (int*) malloc(sizeof(int) * (vertex_count + 1));	//last chunk using a vertex
+	int *local = (int*) malloc(sizeof(int) * (vertex_count + 1));		//its index in that chunk
+	mesh_chunk *chunk = chunks_out;
+	int chunk_count = 0;
+	int written = 0;
+	int i, j;
+
+	if(chunk_of == NULL || local == NULL)
+	{
+		free(chunk_of);
+		free(local);
+		return -1;
+	}
+
+	for(i=0; i<vertex_count; i++)
+		chunk_of[i] = -1;
+
+	for(i=0; i<triangle_count; i++)
+	{
+		unsigned int *triangle = indices + i*3;
+		int added = 0;
+
+		for(j=0; j<3 && chunk_count > 0; j++)
+		{
+			if(chunk_of[triangle[j]] != chunk_count-1 &&
+				(j < 1 || triangle[j] != triangle[0]) && (j < 2 || triangle[j] != triangle[1]))
+				added++;
+		}
+
+		if(chunk_count == 0 || chunk->vertex_count + added > max_vertices)
+		{
+			chunk = chunks_out + chunk_count++;
+			chunk->first_index = i*3;
+			chunk->index_count = 0;
+			chunk->base_vertex = written;
+			chunk->vertex_count = 0;
+		}
+
+		for(j=0; j<3; j++)
+		{
+			unsigned int vertex = triangle[j];
+
+			if(chunk_of[vertex] != chunk_count-1)
+			{
+				chunk_of[vertex] = chunk_count-1;
+				local[vertex] = chunk->vertex_count++;
+				vertices_out[written++] = vertices[vertex];
+			}
+			triangle[j] = local[vertex];
+		}
+		chunk->index_count += 3;
+	}
+
+	free(chunk_of);
+	free(local);
+	*vertex_count_out = written;
+	return chunk_count;
+}
+
+
+/******************************************************************
+*
+* mesh_compute_bounds
+*
+* Axis aligned bounding box of the positions; the sphere is centered
+* on the box and reaches the farthest vertex, which is tighter than
+* the sphere around the box corners
+*
+*******************************************************************/
+
+void mesh_compute_bounds(const mesh_vertex *vertices, int vertex_count, mesh_bounds *bounds_out)
+{
+	float radius_squared = 0.0f;
+	int i, k;
+
+	for(k=0; k<3; k++)
+	{
+		bounds_out->min[k] = vertex_count > 0 ? vertices[0].position[k] : 0.0f;
+		bounds_out->max[k] = bounds_out->min[k];
+	}
+
+	for(i=1; i<vertex_count; i++)
+	{
+		for(k=0; k<3; k++)
+		{
+			if(vertices[i].position[k] < bounds_out->min[k])
+				bounds_out->min[k] = vertices[i].position[k];
+			if(vertices[i].position[k] > bounds_out->max[k])
+				bounds_out->max[k] = vertices[i].position[k];
+		}
+	}
+
+	for(k=0; k<3; k++)
+		bounds_out->center[k] = 0.5f * (bounds_out->min[k] + bounds_out->max[k]);
+
+	for(i=0; i<vertex_count; i++)
+	{
+		float dx = vertices[i].position[0] - bounds_out->center[0];
+		float dy = vertices[i].position[1] - bounds_out->center[1];
+		float dz = vertices[i].position[2] - bounds_out->center[2];
+		float d = dx*dx + dy*dy + dz*dz;
+
+		if(d > radius_squared)
+			radius_squared = d;
+	}
+	bounds_out->radius = sqrtf(radius_squared);
+}
+
+
+/******************************************************************
+*
+* mesh_transform_vertices
+*
+* Applies a column major 4x4 matrix to the positions of the vertices;
+* normals are transformed with the cofactor matrix of its upper 3x3
+* part (the inverse transpose up to scale) and renormalized, so non
+* uniform scales keep them perpendicular to the surface
+*
+*******************************************************************/
+
+void mesh_transform_vertices(mesh_vertex *vertices, int vertex_count, const float *matrix)
+{
+	const float *m = matrix;
+	float cofactor[9];
+	int i, r;
+
+	// column major like the matrix
+	cofactor[0] = m[5]*m[10] - m[9]*m[6];
+	cofactor[1] = m[6]*m[8] - m[10]*m[4];
+	cofactor[2] = m[4]*m[9] - m[8]*m[5];
+	cofactor[3] = m[9]*m[2] - m[1]*m[10];
+	cofactor[4] = m[10]*m[0] - m[2]*m[8];
+	cofactor[5] = m[8]*m[1] - m[0]*m[9];
+	cofactor[6] = m[1]*m[6] - m[5]*m[2];
+	cofactor[7] = m[2]*m[4] - m[6]*m[0];
+	cofactor[8] = m[0]*m[5] - m[4]*m[1];
+
+	for(i=0; i<vertex_count; i++)
+	{
+		float position[3], normal[3], length;
+
+		for(r=0; r<3; r++)
+		{
+			position[r] = m[r]*vertices[i].position[0] + m[4+r]*vertices[i].position[1] +
+					m[8+r]*vertices[i].position[2] + m[12+r];
+			normal[r] = cofactor[r]*vertices[i].normal[0] + cofactor[3+r]*vertices[i].normal[1] +
+					cofactor[6+r]*vertices[i].normal[2];
+		}
+
+		length = sqrtf(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]);
+		for(r=0; r<3; r++)
+		{
+			vertices[i].position[r] = position[r];
+			vertices[i].normal[r] = length > 0.0f ? normal[r] / length : 0.0f;
+		}
+	}
+}
+
+
+/******************************************************************
+*
+* mesh_intersect_ray
+*
+* Nearest hit of the ray origin + t * direction with the triangles
+* of a mesh (Moeller/Trumbore, both sides); returns t, -1 if the ray
+* misses. direction need not be normalized, t is in its units
+*
+*******************************************************************/
+
+float mesh_intersect_ray(const mesh_vertex *vertices, const void *indices, int index_size,
+		const mesh_chunk *chunks, int chunk_count, const float *origin, const float *direction)
+{
+	float nearest = -1.0f;
+	int c, i, k;
+
+	for(c=0; c<chunk_count; c++)
+	{
+		const mesh_vertex *base = vertices + chunks[c].base_vertex;
+
+		for(i=chunks[c].first_index; i<chunks[c].first_index + chunks[c].index_count; i+=3)
+		{
+			const float *p0 = base[mesh_get_index(indices, index_size, i)].position;
+			const float *p1 = base[mesh_get_index(indices, index_size, i+1)].position;
+			const float *p2 = base[mesh_get_index(indices, index_size, i+2)].position;
+			float e1[3], e2[3], p[3], q[3], s[3];
+			float determinant, inverse, u, v, t;
+
+			for(k=0; k<3; k++)
+			{
+				e1[k] = p1[k] - p0[k];
+				e2[k] = p2[k] - p0[k];
+				s[k] = origin[k] - p0[k];
+			}
+
+			p[0] = direction[1]*e2[2] - direction[2]*e2[1];
+			p[1] = direction[2]*e2[0] - direction[0]*e2[2];
+			p[2] = direction[0]*e2[1] - direction[1]*e2[0];
+			determinant = e1[0]*p[0] + e1[1]*p[1] + e1[2]*p[2];
+			if(fabsf(determinant) < 1e-12f)
+				continue;
+			inverse = 1.0f / determinant;
+
+			u = (s[0]*p[0] + s[1]*p[1] + s[2]*p[2]) * inverse;
+			if(u < 0.0f || u > 1.0f)
+				continue;
+
+			q[0] = s[1]*e1[2] - s[2]*e1[1];
+			q[1] = s[2]*e1[0] - s[0]*e1[2];
+			q[2] = s[0]*e1[1] - s[1]*e1[0];
+			v = (direction[0]*q[0] + direction[1]*q[1] + direction[2]*q[2]) * inverse;
+			if(v < 0.0f || u + v > 1.0f)
+				continue;
+
+			t = (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2]) * inverse;
+			if(t >= 0.0f && (nearest < 0.0f || t < nearest))
+				nearest = t;
+		}
+	}
+
+	return nearest;
+}
+
+
+/******************************************************************
+*
+* mesh_index_size
+*
+* Bytes per index needed to address vertex_count vertices
+*
+*******************************************************************/
+
+int mesh_index_size(int vertex_count)
+{
+	return vertex_count <= MESH_MAX_16BIT_VERTICES ? 2 : 4;
+}
+
+
+/******************************************************************
+*
+* mesh_pack_indices
+*
+* Stores 32 bit indices with index_size bytes each; indices_out may
+* alias indices
+*
+*******************************************************************/
+
+void mesh_pack_indices(const unsigned int *indices, int index_count, int index_size, void *indices_out)
+{
+	unsigned short *short_indices = (unsigned short*) indices_out;
+	int i;
+
+	if(index_size == 4)
+	{
+		memmove(indices_out, indices, sizeof(unsigned int) * index_count);
+		return;
+	}
+
+	for(i=0; i<index_count; i++)
+		short_indices[i] = (unsigned short) indices[i];
+}
+
+
+/******************************************************************
+*
+* mesh_get_index
+*
+* Reads index i of an index buffer with index_size bytes per index
+*
+*******************************************************************/
+
+unsigned int mesh_get_index(const void *indices, int index_size, int i)
+{
+	if(index_size == 2)
+		return ((const unsigned short*) indices)[i];
+	return ((const unsigned int*) indices)[i];
+}
+
+
+/******************************************************************
+*
+* mesh_vertex_score
+*
+* Forsyth score of a vertex from its cache position (-1 if not
+* cached) and the number of triangles still using it
+*
+*******************************************************************/
+
+float mesh_vertex_score(int cache_position, int valence)
+{
+	float score = 0.0f;
+
+	if(valence == 0)
+		return -1.0f;
+
+	if(cache_position >= 0)
+	{
+		if(cache_position < 3)
+			score = MESH_LAST_TRIANGLE_SCORE;
+		else
+			score = powf(1.0f - (float)(cache_position - 3) / (MESH_VERTEX_CACHE_SIZE - 3), MESH_CACHE_DECAY_POWER);
+	}
+
+	return score + MESH_VALENCE_BOOST_SCALE * powf((float)valence, -MESH_VALENCE_BOOST_POWER);
+}
+
+
+/******************************************************************
+*
+* mesh_optimize_vertex_cache
+*
+* Reorders the triangles greedily so that each next triangle reuses
+* vertices of a simulated LRU cache, after T. Forsyth, "Linear-Speed
+* Vertex Cache Optimisation", 2006. The new order is only kept if
+* it has fewer simulated cache misses. Returns 0 if out of memory,
+* in which case the indices are unchanged
+*
+*******************************************************************/
+
+int mesh_optimize_vertex_cache(unsigned int *indices, int triangle_count, int vertex_count)
+{
+	int *valence = (int*) calloc(vertex_count + 1, sizeof(int));		//triangles not yet emitted per vertex
+	int *adjacency_offset = (int*) malloc(sizeof(int) * (vertex_count + 1));
+	int *adjacency = (int*) malloc(sizeof(int) * (triangle_count * 3 + 1));	//triangles of every vertex, emitted ones swapped to the end
+	int *cache_position = (int*) malloc(sizeof(int) * (vertex_count + 1));
+	float *vertex_score = (float*) malloc(sizeof(float) * (vertex_count + 1));
+	float *triangle_score = (float*) malloc(sizeof(float) * (triangle_count + 1));
+	char *emitted = (char*) calloc(triangle_count + 1, 1);
+	unsigned int *output = (unsigned int*) malloc(sizeof(unsigned int) * (triangle_count * 3 + 1));
+	int cache[MESH_VERTEX_CACHE_SIZE + 3];
+	int new_cache[MESH_VERTEX_CACHE_SIZE + 3];
+	int cache_count = 0;
+	int scan = 0;
+	int best = -1;
+	int result = 0;
+	int i, j, k, t;
+
+	if(valence != NULL && adjacency_offset != NULL && adjacency != NULL && cache_position != NULL &&
+		vertex_score != NULL && triangle_score != NULL && emitted != NULL && output != NULL)
+	{
+		for(i=0; i<triangle_count*3; i++)
+			valence[indices[i]]++;
+
+		for(i=0, k=0; i<vertex_count; i++)
+		{
+			adjacency_offset[i] = k;
+			k += valence[i];
+			valence[i] = 0;
+		}
+
+		for(t=0; t<triangle_count; t++)
+		{
+			for(j=0; j<3; j++)
+			{
+				unsigned int vertex = indices[t*3+j];
+				adjacency[adjacency_offset[vertex] + valence[vertex]++] = t;
+			}
+		}
+
+		for(i=0; i<vertex_count; i++)
+		{
+			cache_position[i] = -1;
+			vertex_score[i] = mesh_vertex_score(-1, valence[i]);
+		}
+
+		for(t=0; t<triangle_count; t++)
+		{
+			triangle_score[t] = vertex_score[indices[t*3]] + vertex_score[indices[t*3+1]] + vertex_score[indices[t*3+2]];
+			if(best < 0 || triangle_score[t] > triangle_score[best])
+				best = t;
+		}
+
+		for(i=0; i<triangle_count; i++)
+		{
+			int new_cache_count = 0;
+			float best_score = -1.0f;
+
+			// no cached vertex has triangles left, continue with the next one in file order
+			if(best < 0)
+			{
+				while(emitted[scan])
+					scan++;
+				best = scan;
+			}
+
+			memcpy(output + i*3, indices + best*3, sizeof(unsigned int) * 3);
+			emitted[best] = 1;
+
+			for(j=0; j<3; j++)
+			{
+				unsigned int vertex = indices[best*3+j];
+				int *triangles = adjacency + adjacency_offset[vertex];
+
+				// all occurrences, a degenerate triangle is listed twice
+				for(k=valence[vertex]-1; k>=0; k--)
+				{
+					if(triangles[k] == best)
+					{
+						triangles[k] = triangles[--valence[vertex]];
+						triangles[valence[vertex]] = best;
+					}
+				}
+
+				if(cache_position[vertex] != -2)
+				{
+					new_cache[new_cache_count++] = vertex;
+					cache_position[vertex] = -2;	//marks vertices already in new_cache
+				}
+			}
+
+			for(j=0; j<cache_count; j++)
+			{
+				if(cache_position[cache[j]] != -2)
+				{
+					new_cache[new_cache_count++] = cache[j];
+					cache_position[cache[j]] = -2;
+				}
+			}
+
+			// vertices pushed beyond the cache size leave it and are rescored as uncached
+			for(j=0; j<new_cache_count; j++)
+			{
+				unsigned int vertex = new_cache[j];
+
+				cache_position[vertex] = j < MESH_VERTEX_CACHE_SIZE ? j : -1;
+				vertex_score[vertex] = mesh_vertex_score(cache_position[vertex], valence[vertex]);
+			}
+
+			best = -1;
+			for(j=0; j<new_cache_count; j++)
+			{
+				unsigned int vertex = new_cache[j];
+				int *triangles = adjacency + adjacency_offset[vertex];
+
+				for(k=0; k<valence[vertex]; k++)
+				{
+					t = triangles[k];
+					triangle_score[t] = vertex_score[indices[t*3]] + vertex_score[indices[t*3+1]] + vertex_score[indices[t*3+2]];
+					if(triangle_score[t] > best_score)
+					{
+						best_score = triangle_score[t];
+						best = t;
+					}
+				}
+			}
+
+			cache_count = new_cache_count < MESH_VERTEX_CACHE_SIZE ? new_cache_count : MESH_VERTEX_CACHE_SIZE;
+			memcpy(cache, new_cache, sizeof(int) * cache_count);
+		}
+
+		// meshes already stored in a cache friendly order are kept as they are
+		if(mesh_vertex_cache_misses(output, sizeof(unsigned int), triangle_count * 3, vertex_count, MESH_VERTEX_CACHE_SIZE) <
+			mesh_vertex_cache_misses(indices, sizeof(unsigned int), triangle_count * 3, vertex_count, MESH_VERTEX_CACHE_SIZE))
+			memcpy(indices, output, sizeof(unsigned int) * triangle_count * 3);
+		result = 1;
+	}
+
+	free(valence);
+	free(adjacency_offset);
+	free(adjacency);
+	free(cache_position);
+	free(vertex_score);
+	free(triangle_score);
+	free(emitted);
+	free(output);
+	return result;
+}
+
+
+/******************************************************************
+*
+* mesh_optimize_vertex_fetch
+*
+* Renumbers the vertices in the order the index buffer first uses
+* them, so fetches walk the vertex buffer mostly sequentially.
+* Unreferenced vertices are dropped; returns the new vertex count or
+* -1 if out of memory
+*
+*******************************************************************/
+
+int mesh_optimize_vertex_fetch(mesh_vertex *vertices, int vertex_count, unsigned int *indices, int index_count)
+{
+	int *remap = (int*) malloc(sizeof(int) * (vertex_count + 1));
+	mesh_vertex *reordered = (mesh_vertex*) malloc(sizeof(mesh_vertex) * (vertex_count + 1));
+	int count = 0;
+	int i;
+
+	if(remap == NULL || reordered == NULL)
+	{
+		free(remap);
+		free(reordered);
+		return -1;
+	}
+
+	for(i=0; i<vertex_count; i++)
+		remap[i] = -1;
+
+	for(i=0; i<index_count; i++)
+	{
+		unsigned int vertex = indices[i];
+
+		if(remap[vertex] < 0)
+		{
+			remap[vertex] = count;
+			reordered[count++] = vertices[vertex];
+		}
+		indices[i] = remap[vertex];
+	}
+
+	memcpy(vertices, reordered, sizeof(mesh_vertex) * count);
+	free(remap);
+	free(reordered);
+	return count;
+}
+
+
+/******************************************************************
+*
+* mesh_vertex_cache_misses
+*
+* Simulates a FIFO post transform cache of cache_size entries over
+* an index buffer and returns the number of vertex shader runs.
+* Divided by the triangle count this is the ACMR, divided by the
+* vertex count the ATVR (1.0 is optimal)
+*
+*******************************************************************/
+
+int mesh_vertex_cache_misses(const void *indices, int index_size, int index_count, int vertex_count, int cache_size)
+{
+	int *inserted = (int*) malloc(sizeof(int) * (vertex_count + 1));	//miss count when a vertex entered the cache
+	int misses = 0;
+	int i;
+
+	if(inserted == NULL)
+		return -1;
+
+	for(i=0; i<vertex_count; i++)
+		inserted[i] = -cache_size - 1;
+
+	for(i=0; i<index_count; i++)
+	{
+		unsigned int vertex = mesh_get_index(indices, index_size, i);
+
+		if(misses - inserted[vertex] > cache_size)
+			inserted[vertex] = misses++;
+	}
+
+	free(inserted);
+	return misses;
+}
+
+
+/* Symmetric 4x4 matrix of summed squared plane distances, upper triangle row by row */
+typedef struct
+{
+	double a[10];
+} mesh_quadric;
+
+void mesh_quadric_add_plane(mesh_quadric *q, const double *n, double d)
+{
+	q->a[0] += n[0]*n[0]; q->a[1] += n[0]*n[1]; q->a[2] += n[0]*n[2]; q->a[3] += n[0]*d;
+	q->a[4] += n[1]*n[1]; q->a[5] += n[1]*n[2]; q->a[6] += n[1]*d;
+	q->a[7] += n[2]*n[2]; q->a[8] += n[2]*d;
+	q->a[9] += d*d;
+}
+
+double mesh_quadric_error(const mesh_quadric *q, const float *p)
+{
+	double x = p[0], y = p[1], z = p[2];
+	double error = q->a[0]*x*x + q->a[4]*y*y + q->a[7]*z*z + q->a[9] +
+			2.0 * (q->a[1]*x*y + q->a[2]*x*z + q->a[3]*x + q->a[5]*y*z + q->a[6]*y + q->a[8]*z);
+
+	return error > 0.0 ? error : 0.0;
+}
+
+// unit normal of a triangle, returns twice its area
+double mesh_triangle_normal(const float *a, const float *b, const float *c, double *n)
+{
+	double e1[3], e2[3], length;
+	int k;
+
+	for(k=0; k<3; k++)
+	{
+		e1[k] = (double)b[k] - a[k];
+		e2[k] = (double)c[k] - a[k];
+	}
+	n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+	n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+	n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+
+	length = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+	if(length > 0.0)
+	{
+		for(k=0; k<3; k++)
+			n[k] /= length;
+	}
+	return length;
+}
+
+// class a vertex position ended up in after the collapses so far
+int mesh_collapse_target(int *collapsed, int v)
+{
+	int root = v;
+
+	while(collapsed[root] != root)
+		root = collapsed[root];
+	while(collapsed[v] != root)
+	{
+		int next = collapsed[v];
+		collapsed[v] = root;
+		v = next;
+	}
+	return root;
+}
+
+// groups vertices with bitwise equal positions; class_of maps each vertex to the first vertex of its class
+int mesh_position_classes(const mesh_vertex *vertices, int vertex_count, int *class_of)
+{
+	unsigned int table_size = 16;
+	unsigned int mask, slot;
+	int *table;
+	int i;
+
+	while(table_size < (unsigned int)vertex_count * 2)
+		table_size *= 2;
+	mask = table_size - 1;
+
+	table = (int*) malloc(sizeof(int) * table_size);
+	if(table == NULL)
+		return 0;
+	memset(table, 0xff, sizeof(int) * table_size);
+
+	for(i=0; i<vertex_count; i++)
+	{
+		unsigned int bits[3], hash;
+		int found;
+
+		memcpy(bits, vertices[i].position, sizeof(bits));
+		hash = bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u;
+
+		for(slot = (hash ^ (hash >> 16)) & mask; (found = table[slot]) != -1; slot = (slot + 1) & mask)
+		{
+			if(memcmp(vertices[found].position, vertices[i].position, sizeof(vertices[i].position)) == 0)
+				break;
+		}
+
+		if(found == -1)
+			table[slot] = found = i;
+		class_of[i] = found;
+	}
+
+	free(table);
+	return 1;
+}
+
+typedef struct
+{
+	int from;
+	int to;
+	float cost;
+} mesh_collapse;
+
+int mesh_compare_collapses(const void *a, const void *b)
+{
+	float ca = ((const mesh_collapse*)a)->cost;
+	float cb = ((const mesh_collapse*)b)->cost;
+
+	return ca < cb ? -1 : (ca > cb ? 1 : 0);
+}
+
+int mesh_compare_edges(const void *a, const void *b)
+{
+	unsigned long long ea = *(const unsigned long long*)a;
+	unsigned long long eb = *(const unsigned long long*)b;
+
+	return ea < eb ? -1 : (ea > eb ? 1 : 0);
+}
+
+// locks the position classes on open or non-manifold edges, the simplifier keeps them in place
+void mesh_lock_border_classes(const unsigned int *indices, int index_count, const int *class_of,
+		unsigned long long *edges, unsigned char *locked)
+{
+	int i, k, run;
+
+	for(i=0; i<index_count; i+=3)
+	{
+		for(k=0; k<3; k++)
+		{
+			unsigned long long a = class_of[indices[i + k]];
+			unsigned long long b = class_of[indices[i + (k + 1) % 3]];
+			edges[i + k] = a < b ? (a << 32) | b : (b << 32) | a;
+		}
+	}
+	qsort(edges, index_count, sizeof(unsigned long long), mesh_compare_edges);
+
+	for(i=0; i<index_count; i+=run)
+	{
+		for(run=1; i + run < index_count && edges[i + run] == edges[i]; run++)
+			;
+		if(run != 2)
+		{
+			locked[edges[i] >> 32] = 1;
+			locked[edges[i] & 0xffffffffu] = 1;
+		}
+	}
+}
+
+
+/******************************************************************
+*
+* mesh_simplify
+*
+* Quadric error metric simplification (Garland/Heckbert) of an index
+* buffer; the vertex buffer stays as it is, so all levels of detail
+* can share it. Collapses work on vertex positions: every vertex of
+* a collapsed position is redirected to the vertex of the remaining
+* position with the closest attributes, which keeps normal and
+* material seams intact. Each pass sorts the possible edge collapses
+* by their error and applies the cheapest ones that touch disjoint
+* positions and flip no triangle, until target_index_count or
+* max_error (a distance in position units) is reached. Positions on
+* open edges are kept. Writes the new indices, at most index_count,
+* and returns their number; error_out receives the largest error
+* accepted. Returns -1 if out of memory
+*
+*******************************************************************/
+
+int mesh_simplify(const mesh_vertex *vertices, int vertex_count, const unsigned int *indices, int index_count,
+		int target_index_count, float max_error, unsigned int *indices_out, float *error_out)
+{
+	int *class_of = (int*) malloc(sizeof(int) * (vertex_count + 1));
+	int *collapsed = (int*) malloc(sizeof(int) * (vertex_count + 1));
+	int *class_first = (int*) malloc(sizeof(int) * (vertex_count + 2));		//vertices of each class, CSR
+	int *class_vertices = (int*) malloc(sizeof(int) * (vertex_count + 1));
+	int *adjacency_offset = (int*) malloc(sizeof(int) * (vertex_count + 2));	//triangles of each class, CSR
+	int *adjacency = (int*) malloc(sizeof(int) * (index_count + 1));
+	int *remap = (int*) malloc(sizeof(int) * (vertex_count + 1));
+	unsigned char *locked = (unsigned char*) calloc(vertex_count + 1, 1);
+	unsigned char *touched = (unsigned char*) malloc(vertex_count + 1);
+	mesh_quadric *quadrics = (mesh_quadric*) calloc(vertex_count + 1, sizeof(mesh_quadric));
+	mesh_collapse *collapses = (mesh_collapse*) malloc(sizeof(mesh_collapse) * (index_count + 1));
+	unsigned long long *edges = (unsigned long long*) malloc(sizeof(unsigned long long) * (index_count + 1));
+	double max_cost = (double)max_error * max_error;
+	double accepted_cost = 0.0;
+	int result = -1;
+	int count = index_count;
+	int i, k;
+
+	if(class_of == NULL || collapsed == NULL || class_first == NULL || class_vertices == NULL ||
+		adjacency_offset == NULL || adjacency == NULL || remap == NULL || locked == NULL || touched == NULL ||
+		quadrics == NULL || collapses == NULL || edges == NULL ||
+		!mesh_position_classes(vertices, vertex_count, class_of))
+	{
+		count = -1;
+	}
+
+	if(count >= 0)
+	{
+		memcpy(indices_out, indices, sizeof(unsigned int) * index_count);
+		mesh_lock_border_classes(indices, index_count, class_of, edges, locked);
+
+		for(i=0; i<vertex_count; i++)
+			collapsed[i] = i;
+
+		// every position starts with the planes of the triangles around it
+		for(i=0; i<index_count; i+=3)
+		{
+			const float *p = vertices[class_of[indices[i]]].position;
+			double n[3];
+
+			mesh_triangle_normal(p, vertices[class_of[indices[i+1]]].position, vertices[class_of[indices[i+2]]].position, n);
+			for(k=0; k<3; k++)
+				mesh_quadric_add_plane(quadrics + class_of[indices[i + k]], n, -(n[0]*p[0] + n[1]*p[1] + n[2]*p[2]));
+		}
+	}
+
+	while(count > target_index_count)
+	{
+		int collapse_count = 0;
+		int applied = 0;
+		int written = 0;
+		double pass_cost;
+		int goal;
+
+		// triangles around each remaining position
+		memset(adjacency_offset, 0, sizeof(int) * (vertex_count + 2));
+		for(i=0; i<count; i++)
+			adjacency_offset[mesh_collapse_target(collapsed, class_of[indices_out[i]]) + 2]++;
+		for(i=0; i<vertex_count; i++)
+			adjacency_offset[i + 2] += adjacency_offset[i + 1];
+		for(i=0; i<count; i++)
+			adjacency[adjacency_offset[mesh_collapse_target(collapsed, class_of[indices_out[i]]) + 1]++] = i / 3;
+
+		// candidate collapses in both directions of every edge
+		for(i=0; i<count; i++)
+		{
+			int from = mesh_collapse_target(collapsed, class_of[indices_out[i]]);
+			int to = mesh_collapse_target(collapsed, class_of[indices_out[i - i % 3 + (i + 1) % 3]]);
+			mesh_quadric sum;
+
+			if(locked[from])
+				continue;
+
+			for(k=0; k<10; k++)
+				sum.a[k] = quadrics[from].a[k] + quadrics[to].a[k];
+			collapses[collapse_count].from = from;
+			collapses[collapse_count].to = to;
+			collapses[collapse_count].cost = (float) mesh_quadric_error(&sum, vertices[to].position);
+			collapse_count++;
+		}
+		qsort(collapses, collapse_count, sizeof(mesh_collapse), mesh_compare_collapses);
+
+		// a pass stops a bit above the cost of the collapses it needs, the blocked cheaper ones get the next pass
+		goal = (count - target_index_count) / 6;
+		pass_cost = goal < collapse_count ? collapses[goal].cost * 1.5 : max_cost;
+		if(pass_cost > max_cost)
+			pass_cost = max_cost;
+
+		memset(touched, 0, vertex_count + 1);
+		for(i=0; i<collapse_count && count - applied * 6 > target_index_count; i++)
+		{
+			int from = collapses[i].from;
+			int to = collapses[i].to;
+			int t, flips = 0;
+
+			if(collapses[i].cost > pass_cost)
+				break;
+			if(touched[from] || touched[to])
+				continue;
+
+			// moving 'from' onto 'to' must not turn any remaining triangle around
+			for(t=adjacency_offset[from]; t<adjacency_offset[from + 1] && !flips; t++)
+			{
+				const float *before[3], *after[3];
+				int shared = 0;
+				double n_before[3], n_after[3];
+
+				for(k=0; k<3; k++)
+				{
+					int c = mesh_collapse_target(collapsed, class_of[indices_out[adjacency[t] * 3 + k]]);
+					shared |= c == to;
+					before[k] = vertices[c].position;
+					after[k] = c == from ? vertices[to].position : before[k];
+				}
+				if(shared)
+					continue;
+
+				mesh_triangle_normal(before[0], before[1], before[2], n_before);
+				if(mesh_triangle_normal(after[0], after[1], after[2], n_after) <= 0.0 ||
+					n_before[0]*n_after[0] + n_before[1]*n_after[1] + n_before[2]*n_after[2] < 0.25)
+					flips = 1;
+			}
+			if(flips)
+				continue;
+
+			collapsed[from] = to;
+			for(k=0; k<10; k++)
+				quadrics[to].a[k] += quadrics[from].a[k];
+			touched[from] = touched[to] = 1;
+			if(collapses[i].cost > accepted_cost)
+				accepted_cost = collapses[i].cost;
+			applied++;
+		}
+
+		if(applied == 0)
+			break;
+
+		// drop the triangles that collapsed to a line
+		for(i=0; i<count; i+=3)
+		{
+			int a = mesh_collapse_target(collapsed, class_of[indices_out[i]]);
+			int b = mesh_collapse_target(collapsed, class_of[indices_out[i+1]]);
+			int c = mesh_collapse_target(collapsed, class_of[indices_out[i+2]]);
+
+			if(a != b && b != c && a != c)
+			{
+				for(k=0; k<3; k++)
+					indices_out[written + k] = indices_out[i + k];
+				written += 3;
+			}
+		}
+		count = written;
+	}
+
+	if(count >= 0)
+	{
+		// vertices of each position class
+		memset(class_first, 0, sizeof(int) * (vertex_count + 2));
+		for(i=0; i<vertex_count; i++)
+			class_first[class_of[i] + 2]++;
+		for(i=0; i<vertex_count; i++)
+			class_first[i + 2] += class_first[i + 1];
+		for(i=0; i<vertex_count; i++)
+			class_vertices[class_first[class_of[i] + 1]++] = i;
+
+		// redirect each vertex to the most similar vertex at the position it collapsed to
+		for(i=0; i<vertex_count; i++)
+			remap[i] = -1;
+
+		for(i=0; i<count; i++)
+		{
+			int v = indices_out[i];
+			int target = mesh_collapse_target(collapsed, class_of[v]);
+
+			if(remap[v] < 0)
+			{
+				float best_score = -1e30f;
+
+				remap[v] = v;
+				for(k=class_first[target]; target != class_of[v] && k<class_first[target + 1]; k++)
+				{
+					const mesh_vertex *candidate = vertices + class_vertices[k];
+					float score = candidate->normal[0]*vertices[v].normal[0] + candidate->normal[1]*vertices[v].normal[1] +
+							candidate->normal[2]*vertices[v].normal[2];
+
+					if(candidate->material_index != vertices[v].material_index)
+						score -= 4.0f;
+					score -= fabsf(candidate->texcoord[0] - vertices[v].texcoord[0]) + fabsf(candidate->texcoord[1] - vertices[v].texcoord[1]);
+
+					if(score > best_score)
+					{
+						best_score = score;
+						remap[v] = class_vertices[k];
+					}
+				}
+			}
+			indices_out[i] = remap[v];
+		}
+
+		if(error_out != NULL)
+			*error_out = (float) sqrt(accepted_cost);
+		result = count;
+	}
+
+	free(edges);
+	free(collapses);
+	free(quadrics);
+	free(touched);
+	free(locked);
+	free(remap);
+	free(adjacency);
+	free(adjacency_offset);
+	free(class_vertices);
+	free(class_first);
+	free(collapsed);
+	free(class_of);
+	return result;
+}
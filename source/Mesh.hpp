@@ -0,0 +1,112 @@
+/******************************************************************
+*
+* Mesh.h
+*
+* Description: Processing stages for triangle meshes after parsing.
+*              Polygons are triangulated by ear clipping. Welding
+*              turns the separately indexed OBJ attributes into one
+*              interleaved vertex per distinct corner and a single
+*              index stream, as required by glDrawElements. Indices
+*              are stored with 16 bits where the vertex count allows
+*              it; larger meshes keep 32 bits or are split into
+*              chunks of at most 65536 vertices drawn with a base
+*              vertex. Triangles are reordered for the post transform
+*              vertex cache (Forsyth) and vertices for fetch locality.
+*
+* Computer Graphics Proseminar SS 2015
+* 
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*******************************************************************/
+
+#ifndef __MESH_H__
+#define __MESH_H__
+
+#define MESH_MAX_16BIT_VERTICES 65536
+
+/* Mesh load flags */
+#define MESH_SPLIT_16BIT 1	//split meshes with more vertices than 16 bit indices address into chunks
+#define MESH_KEEP_ORDER 2	//skip the vertex cache and vertex fetch reordering
+#define MESH_NO_LODS 4		//skip the generation of simplified levels of detail
+
+#define MESH_VERTEX_CACHE_SIZE 32	//FIFO entries assumed by the optimizer and the statistics
+
+/* Levels of detail: each level aims at half the triangles of the previous one */
+#define MESH_MAX_LODS 4
+#define MESH_LOD_MIN_TRIANGLES 2000	//smaller meshes only keep the full level
+#define MESH_LOD_MAX_ERROR 0.05f	//largest simplification error, relative to the bounding sphere radius
+
+/* Interleaved vertex as uploaded to the vertex buffer */
+typedef struct
+{
+	float position[3];
+	float normal[3];
+	float texcoord[2];
+	int material_index;
+} mesh_vertex;
+
+/* Attribute indices of one triangle corner, zero based, -1 if absent */
+typedef struct
+{
+	int position;
+	int texcoord;
+	int normal;
+	int material;
+} mesh_corner;
+
+/* Range of the index buffer drawn with its own base vertex */
+typedef struct
+{
+	int first_index;
+	int index_count;
+	int base_vertex;
+	int vertex_count;
+} mesh_chunk;
+
+/* Index range of one level of detail; error is the distance the simplification moved the surface by, in model units */
+typedef struct
+{
+	int first_index;
+	int index_count;
+	float error;
+} mesh_lod;
+
+/* Axis aligned box and bounding sphere of the vertex positions */
+typedef struct
+{
+	float min[3];
+	float max[3];
+	float center[3];	//box center, also the sphere center
+	float radius;
+} mesh_bounds;
+
+int mesh_triangulate_polygon(const float *positions, const int *position_indices, int corner_count,
+		int *triangles_out, int *work);
+
+int mesh_weld(const float *positions, const float *normals, const float *texcoords,
+		const mesh_corner *corners, int corner_count,
+		mesh_vertex *vertices_out, unsigned int *indices_out);
+int mesh_split(const mesh_vertex *vertices, int vertex_count, unsigned int *indices, int triangle_count,
+		int max_vertices, mesh_vertex *vertices_out, mesh_chunk *chunks_out, int *vertex_count_out);
+
+int mesh_optimize_vertex_cache(unsigned int *indices, int triangle_count, int vertex_count);
+int mesh_optimize_vertex_fetch(mesh_vertex *vertices, int vertex_count, unsigned int *indices, int index_count);
+int mesh_simplify(const mesh_vertex *vertices, int vertex_count, const unsigned int *indices, int index_count,
+		int target_index_count, float max_error, unsigned int *indices_out, float *error_out);
+
+int mesh_vertex_cache_misses(const void *indices, int index_size, int index_count, int vertex_count, int cache_size);
+
+void mesh_compute_bounds(const mesh_vertex *vertices, int vertex_count, mesh_bounds *bounds_out);
+void mesh_transform_vertices(mesh_vertex *vertices, int vertex_count, const float *matrix);
+
+float mesh_intersect_ray(const mesh_vertex *vertices, const void *indices, int index_size,
+		const mesh_chunk *chunks, int chunk_count, const float *origin, const float *direction);
+
+int mesh_index_size(int vertex_count);
+void mesh_pack_indices(const unsigned int *indices, int index_count, int index_size, void *indices_out);
+unsigned int mesh_get_index(const void *indices, int index_size, int i);
+
+#endif // __MESH_H__
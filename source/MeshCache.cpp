@@ -0,0 +1,334 @@
+/******************************************************************
+*
+* MeshCache.c
+*
+* Description: Binary cache for packed meshes, see MeshCache.h
+*
+* Computer Graphics Proseminar SS 2015
+* 
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*******************************************************************/
+
+/* Standard includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MeshCache.hpp"
+
+static const char mesh_cache_magic[8] = "MGRMESH";
+
+
+/******************************************************************
+*
+* mesh_cache_arrays
+*
+* Collects the array pointers of a mesh in the order they are
+* stored in its block; returns their number
+*
+*******************************************************************/
+
+int mesh_cache_arrays(obj_mesh *mesh, void ***arrays)
+{
+	int count = 0;
+
+	arrays[count++] = (void**) &mesh->vertices;
+	arrays[count++] = (void**) &mesh->indices;
+	arrays[count++] = (void**) &mesh->chunks;
+	arrays[count++] = (void**) &mesh->materials;
+
+	return count;
+}
+
+
+/******************************************************************
+*
+* mesh_cache_array_sizes
+*
+* Byte sizes of the arrays of mesh_cache_arrays, in the same order;
+* returns 0 if a count or the index size is invalid
+*
+*******************************************************************/
+
+int mesh_cache_array_sizes(const obj_mesh *mesh, unsigned long long *sizes)
+{
+	if(mesh->vertex_count < 0 || mesh->index_count < 0 || mesh->chunk_count < 0 ||
+		mesh->material_count < 0 || (mesh->index_size != 2 && mesh->index_size != 4))
+		return 0;
+
+	sizes[0] = (unsigned long long)mesh->vertex_count * sizeof(mesh_vertex);
+	sizes[1] = (unsigned long long)mesh->index_count * mesh->index_size;
+	sizes[2] = (unsigned long long)mesh->chunk_count * sizeof(mesh_chunk);
+	sizes[3] = (unsigned long long)mesh->material_count * sizeof(obj_material);
+
+	return 1;
+}
+
+
+/******************************************************************
+*
+* mesh_cache_filename
+*
+* models/name.obj -> models/name.mesh
+*
+*******************************************************************/
+
+void mesh_cache_filename(const char *filename, char *cache_filename)
+{
+	const char *extension = strrchr(filename, '.');
+	int length = extension ? extension - filename : strlen(filename);
+
+	if(length > OBJ_FILENAME_LENGTH - 6)
+		length = OBJ_FILENAME_LENGTH - 6;
+
+	memcpy(cache_filename, filename, length);
+	strcpy(cache_filename + length, ".mesh");
+}
+
+
+/******************************************************************
+*
+* mesh_cache_hash_file
+*
+* 64 bit FNV-1a hash of the file contents; 0 if it cannot be read
+*
+*******************************************************************/
+
+unsigned long long mesh_cache_hash_file(const char *filename)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	const unsigned char *buffer;
+	size_t size, i;
+
+	buffer = (const unsigned char*) obj_map_file(filename, &size);
+	if(buffer == NULL)
+		return 0;
+
+	for(i=0; i<size; i++)
+	{
+		hash ^= buffer[i];
+		hash *= 1099511628211ULL;
+	}
+
+	obj_unmap_file((const char*)buffer, size);
+	return hash;
+}
+
+
+/******************************************************************
+*
+* mesh_cache_map
+*
+* Maps a cache file and points the mesh into it if it is valid
+* for the given OBJ hash, load flags and the current MTL file; a
+* truncated or inconsistent file is rejected so that it is reparsed
+*
+*******************************************************************/
+
+int mesh_cache_map(obj_mesh *mesh_out, const char *cache_filename, unsigned long long obj_hash, int flags)
+{
+	const mesh_cache_header *header;
+	const char *mapping;
+	void **arrays[MESH_CACHE_MAX_ARRAYS];
+	unsigned long long sizes[MESH_CACHE_MAX_ARRAYS];
+	size_t size;
+	int count, i;
+
+	mapping = obj_map_file(cache_filename, &size);
+	if(mapping == NULL)
+		return 0;
+
+	header = (const mesh_cache_header*) mapping;
+	if(size < sizeof(mesh_cache_header) ||
+		memcmp(header->magic, mesh_cache_magic, sizeof(mesh_cache_magic)) != 0 ||
+		header->version != MESH_CACHE_VERSION ||
+		header->mesh_size != sizeof(obj_mesh) ||
+		header->material_size != sizeof(obj_material) ||
+		header->obj_hash != obj_hash ||
+		header->mesh.flags != flags ||
+		header->header_size < sizeof(mesh_cache_header) ||
+		header->mesh.block_size > size ||
+		header->header_size > size - header->mesh.block_size ||
+		!mesh_cache_array_sizes(&header->mesh, sizes) ||
+		header->mesh.lod_count < 1 || header->mesh.lod_count > MESH_MAX_LODS ||
+		memchr(header->mesh.material_filename, '\0', sizeof(header->mesh.material_filename)) == NULL)
+	{
+		obj_unmap_file(mapping, size);
+		return 0;
+	}
+
+	if(header->mesh.material_filename[0] != '\0' &&
+		mesh_cache_hash_file(header->mesh.material_filename) != header->mtl_hash)
+	{
+		obj_unmap_file(mapping, size);
+		return 0;
+	}
+
+	*mesh_out = header->mesh;
+	mesh_out->block = (void*)(mapping + header->header_size);
+	mesh_out->mapping = mapping;
+	mesh_out->mapping_size = size;
+
+	count = mesh_cache_arrays(mesh_out, arrays);
+	for(i=0; i<count; i++)
+	{
+		if(header->offsets[i] > mesh_out->block_size || sizes[i] > mesh_out->block_size - header->offsets[i])
+		{
+			obj_unmap_file(mapping, size);
+			return 0;
+		}
+		*arrays[i] = (char*)mesh_out->block + header->offsets[i];
+	}
+
+	// chunks are read on the CPU for picking, so their indices must stay inside their vertices
+	for(i=0; i<mesh_out->chunk_count; i++)
+	{
+		const mesh_chunk *chunk = mesh_out->chunks + i;
+		int k;
+
+		if(chunk->first_index < 0 || chunk->index_count < 0 ||
+			chunk->first_index > mesh_out->index_count - chunk->index_count ||
+			chunk->base_vertex < 0 || chunk->vertex_count < 0 ||
+			chunk->base_vertex > mesh_out->vertex_count - chunk->vertex_count)
+		{
+			obj_unmap_file(mapping, size);
+			return 0;
+		}
+		for(k=chunk->first_index; k<chunk->first_index + chunk->index_count; k++)
+		{
+			if(mesh_get_index(mesh_out->indices, mesh_out->index_size, k) >= (unsigned int)chunk->vertex_count)
+			{
+				obj_unmap_file(mapping, size);
+				return 0;
+			}
+		}
+	}
+
+	// levels of detail are index ranges drawn with the base vertex of the single chunk
+	if(mesh_out->lod_count > 1 && mesh_out->chunk_count != 1)
+	{
+		obj_unmap_file(mapping, size);
+		return 0;
+	}
+	for(i=0; i<mesh_out->lod_count; i++)
+	{
+		const mesh_lod *lod = mesh_out->lods + i;
+		int k;
+
+		if(lod->first_index < 0 || lod->index_count < 0 ||
+			lod->first_index > mesh_out->index_count - lod->index_count)
+		{
+			obj_unmap_file(mapping, size);
+			return 0;
+		}
+		// the full level is made of the chunks checked above
+		if(i == 0)
+			continue;
+		for(k=lod->first_index; k<lod->first_index + lod->index_count; k++)
+		{
+			if(mesh_get_index(mesh_out->indices, mesh_out->index_size, k) >= (unsigned int)mesh_out->chunks[0].vertex_count)
+			{
+				obj_unmap_file(mapping, size);
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+
+/******************************************************************
+*
+* write_mesh_cache
+*
+* Writes header and array block of a mesh; the file is written
+* under a temporary name first so readers never see partial files
+*
+*******************************************************************/
+
+int write_mesh_cache(obj_mesh *mesh, const char *cache_filename, unsigned long long obj_hash)
+{
+	mesh_cache_header header;
+	char temp_filename[OBJ_FILENAME_LENGTH + 8];
+	char padding[16] = {0};
+	void **arrays[MESH_CACHE_MAX_ARRAYS];
+	FILE *cache_file;
+	int count, i;
+	int written;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, mesh_cache_magic, sizeof(mesh_cache_magic));
+	header.version = MESH_CACHE_VERSION;
+	header.header_size = (sizeof(mesh_cache_header) + 15) & ~15;
+	header.mesh_size = sizeof(obj_mesh);
+	header.material_size = sizeof(obj_material);
+	header.obj_hash = obj_hash;
+	header.mtl_hash = mesh->material_filename[0] != '\0' ? mesh_cache_hash_file(mesh->material_filename) : 0;
+
+	count = mesh_cache_arrays(mesh, arrays);
+	for(i=0; i<count; i++)
+		header.offsets[i] = (char*)*arrays[i] - (char*)mesh->block;
+
+	header.mesh = *mesh;
+	count = mesh_cache_arrays(&header.mesh, arrays);
+	for(i=0; i<count; i++)
+		*arrays[i] = NULL;
+	header.mesh.block = NULL;
+	header.mesh.mapping = NULL;
+	header.mesh.mapping_size = 0;
+
+	snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", cache_filename);
+	cache_file = fopen(temp_filename, "wb");
+	if(cache_file == NULL)
+	{
+		fprintf(stderr, "Could not write mesh cache %s\n", cache_filename);
+		return 0;
+	}
+
+	written = fwrite(&header, sizeof(header), 1, cache_file) == 1 &&
+		fwrite(padding, 1, header.header_size - sizeof(header), cache_file) == header.header_size - sizeof(header) &&
+		fwrite(mesh->block, mesh->block_size, 1, cache_file) == 1;
+
+	if(fclose(cache_file) != 0 || !written || rename(temp_filename, cache_filename) != 0)
+	{
+		fprintf(stderr, "Could not write mesh cache %s\n", cache_filename);
+		remove(temp_filename);
+		return 0;
+	}
+
+	return 1;
+}
+
+
+/******************************************************************
+*
+* load_cached_obj_mesh
+*
+* Drop-in replacement for parse_obj_mesh using the cache; a cache
+* built with other load flags is rebuilt
+*
+*******************************************************************/
+
+int load_cached_obj_mesh(obj_mesh *mesh_out, char *filename, int flags)
+{
+	char cache_filename[OBJ_FILENAME_LENGTH];
+	unsigned long long obj_hash = mesh_cache_hash_file(filename);
+
+	mesh_cache_filename(filename, cache_filename);
+
+	if(obj_hash != 0 && mesh_cache_map(mesh_out, cache_filename, obj_hash, flags))
+		return 1;
+
+	if(!parse_obj_mesh(mesh_out, filename, flags))
+		return 0;
+
+	if(obj_hash != 0)
+		write_mesh_cache(mesh_out, cache_filename, obj_hash);
+
+	return 1;
+}
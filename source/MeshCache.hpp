@@ -0,0 +1,47 @@
+/******************************************************************
+*
+* MeshCache.h
+*
+* Description: Binary cache for packed meshes. The first load of an
+*              OBJ file writes its obj_mesh next to the source
+*              (models/name.obj -> models/name.mesh); later loads map
+*              that file and point the mesh arrays into the mapping.
+*              The cache is rebuilt whenever the hash of the OBJ or
+*              the MTL file it references changes.
+*
+* Computer Graphics Proseminar SS 2015
+* 
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*******************************************************************/
+
+#ifndef __MESH_CACHE_H__
+#define __MESH_CACHE_H__
+
+#include "OBJParser.hpp"
+
+#define MESH_CACHE_VERSION 7
+#define MESH_CACHE_MAX_ARRAYS 16
+
+typedef struct
+{
+	char magic[8];			//"MGRMESH"
+	unsigned int version;
+	unsigned int header_size;	//offset of the array block, multiple of 16
+	unsigned int mesh_size;		//sizeof(obj_mesh) of the writer
+	unsigned int material_size;	//sizeof(obj_material) of the writer
+	unsigned long long obj_hash;
+	unsigned long long mtl_hash;
+
+	unsigned long long offsets[MESH_CACHE_MAX_ARRAYS];	//array offsets relative to the block
+	obj_mesh mesh;			//counts and names, pointers are not used
+} mesh_cache_header;
+
+unsigned long long mesh_cache_hash_file(const char *filename);
+int load_cached_obj_mesh(obj_mesh *mesh_out, char *filename, int flags);
+int write_mesh_cache(obj_mesh *mesh, const char *cache_filename, unsigned long long obj_hash);
+
+#endif // __MESH_CACHE_H__
@@ -8,6 +8,11 @@
 *              is required in the OBJ file. Also, for texture
 *              coordinates three parameters, i.e. u, v, w, are
 *              expected.
+*
+*              The OBJ file is mapped into memory and scanned in a
+*              single pass; vertex data and face indices are written
+*              into contiguous arrays instead of one heap block per
+*              line.
 * 
 * Courtesy of http://www.kixor.net
 *
@@ -23,6 +28,13 @@
 #include <string.h>
 #include <stdlib.h>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif // WIN32
+
 #include "OBJParser.hpp"
 #define WHITESPACE " \t\n\r"
 
@@ -30,8 +42,279 @@
 
 void obj_free_half_list(list *listo)
 {
-	list_delete_all(listo);
-	free(listo->names);
+	list_detach_items(listo);
+}
+
+// contiguous storage for the bulk data of the parser
+void obj_array_make(obj_array *array, int item_size)
+{
+	array->items = NULL;
+	array->item_size = item_size;
+	array->count = 0;
+	array->capacity = 0;
+}
+
+// returns NULL if out of memory, the array then keeps its items
+void* obj_array_push(obj_array *array, int count)
+{
+	void *slot;
+
+	if(array->count + count > array->capacity)
+	{
+		int new_capacity = array->capacity ? array->capacity * 2 : 1024;
+		void *items;
+		while(new_capacity < array->count + count)
+			new_capacity *= 2;
+
+		items = realloc(array->items, (size_t)new_capacity * array->item_size);
+		if(items == NULL)
+			return NULL;
+		array->items = items;
+		array->capacity = new_capacity;
+	}
+
+	slot = (char*)array->items + (size_t)array->count * array->item_size;
+	array->count += count;
+	return slot;
+}
+
+void obj_array_free(obj_array *array)
+{
+	free(array->items);
+	obj_array_make(array, array->item_size);
+}
+
+// 16 byte aligned storage for packed meshes
+#define OBJ_ALIGNMENT 16
+
+size_t obj_align(size_t size)
+{
+	return (size + OBJ_ALIGNMENT - 1) & ~(size_t)(OBJ_ALIGNMENT - 1);
+}
+
+void* obj_aligned_alloc(size_t size)
+{
+#ifdef WIN32
+	return _aligned_malloc(size, OBJ_ALIGNMENT);
+#else
+	void *memory;
+	if(posix_memalign(&memory, OBJ_ALIGNMENT, size) != 0)
+		return NULL;
+	return memory;
+#endif // WIN32
+}
+
+void obj_aligned_free(void *memory)
+{
+#ifdef WIN32
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif // WIN32
+}
+
+// memory mapped file access
+const char* obj_map_file(const char *filename, size_t *size)
+{
+#ifdef WIN32
+	FILE *infile;
+	char *buffer;
+
+	fopen_s(&infile, filename, "rb");
+	if(!infile)
+		return NULL;
+
+	fseek(infile, 0, SEEK_END);
+	*size = ftell(infile);
+	fseek(infile, 0, SEEK_SET);
+
+	buffer = (char*) malloc(*size + 1);
+	*size = fread(buffer, 1, *size, infile);
+	fclose(infile);
+
+	return buffer;
+#else
+	struct stat file_info;
+	void *mapping;
+	int fd = open(filename, O_RDONLY);
+
+	if(fd < 0)
+		return NULL;
+
+	if(fstat(fd, &file_info) != 0)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	*size = file_info.st_size;
+	if(*size == 0)
+	{
+		close(fd);
+		return "";
+	}
+
+	mapping = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(mapping == MAP_FAILED)
+		return NULL;
+
+	madvise(mapping, *size, MADV_SEQUENTIAL);
+	return (const char*)mapping;
+#endif // WIN32
+}
+
+void obj_unmap_file(const char *buffer, size_t size)
+{
+#ifdef WIN32
+	free((void*)buffer);
+#else
+	if(size > 0)
+		munmap((void*)buffer, size);
+#endif // WIN32
+}
+
+// scanner helpers, all of them stop at the end of the current line
+const char* obj_skip_space(const char *p, const char *end)
+{
+	while(p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+	return p;
+}
+
+const char* obj_skip_line(const char *p, const char *end)
+{
+	const char *eol = (const char*) memchr(p, '\n', end - p);
+	return eol ? eol + 1 : end;
+}
+
+const char* obj_token_end(const char *p, const char *end)
+{
+	while(p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+		p++;
+	return p;
+}
+
+char obj_token_equal(const char *token, const char *token_end, const char *keyword)
+{
+	int length = token_end - token;
+	return strncmp(token, keyword, length) == 0 && keyword[length] == '\0';
+}
+
+// copies the next token into a zero terminated buffer
+const char* obj_copy_token(const char *p, const char *end, char *out, int out_size)
+{
+	const char *token_end;
+	int length;
+
+	p = obj_skip_space(p, end);
+	token_end = obj_token_end(p, end);
+	length = token_end - p;
+	if(length > out_size - 1)
+		length = out_size - 1;
+
+	memcpy(out, p, length);
+	out[length] = '\0';
+	return token_end;
+}
+
+const char* obj_parse_int(const char *p, const char *end, int *out)
+{
+	int sign = 1;
+	int value = 0;
+
+	if(p < end && (*p == '-' || *p == '+'))
+	{
+		if(*p == '-')
+			sign = -1;
+		p++;
+	}
+
+	while(p < end && *p >= '0' && *p <= '9')
+	{
+		value = value * 10 + (*p - '0');
+		p++;
+	}
+
+	*out = sign * value;
+	return p;
+}
+
+static const double obj_powers_of_ten[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+double obj_scale_by_power_of_ten(double value, int exponent)
+{
+	while(exponent > 22)
+	{
+		value *= 1e22;
+		exponent -= 22;
+	}
+	while(exponent < -22)
+	{
+		value /= 1e22;
+		exponent += 22;
+	}
+
+	if(exponent >= 0)
+		return value * obj_powers_of_ten[exponent];
+	return value / obj_powers_of_ten[-exponent];
+}
+
+// replacement for atof on a line that is not zero terminated
+const char* obj_parse_float(const char *p, const char *end, float *out)
+{
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	int exponent_part;
+	char negative = 0;
+
+	p = obj_skip_space(p, end);
+
+	if(p < end && (*p == '-' || *p == '+'))
+	{
+		negative = (*p == '-');
+		p++;
+	}
+
+	for(; p < end && *p >= '0' && *p <= '9'; p++)
+	{
+		if(digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			if(mantissa != 0)
+				digits++;
+		}
+		else
+			exponent++;
+	}
+
+	if(p < end && *p == '.')
+	{
+		for(p++; p < end && *p >= '0' && *p <= '9'; p++)
+		{
+			if(digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if(mantissa != 0)
+					digits++;
+				exponent--;
+			}
+		}
+	}
+
+	if(p < end && (*p == 'e' || *p == 'E'))
+	{
+		p = obj_parse_int(p + 1, end, &exponent_part);
+		exponent += exponent_part;
+	}
+
+	*out = (float)obj_scale_by_power_of_ten(negative ? -(double)mantissa : (double)mantissa, exponent);
+	return p;
 }
 
 int obj_convert_to_list_index(int current_max, int index)
@@ -45,6 +328,15 @@ int obj_convert_to_list_index(int current_max, int index)
 	return index - 1;  //normal counting index
 }
 
+// like obj_convert_to_list_index, but -1 as well if the index refers to an item not parsed yet
+int obj_resolve_index(int current_max, int index)
+{
+	index = obj_convert_to_list_index(current_max, index);
+	if(index < 0 || index >= current_max)
+		return -1;
+	return index;
+}
+
 void obj_convert_to_list_index_v(int current_max, int *indices)
 {
 int i;
@@ -71,247 +363,299 @@ void obj_set_material_defaults(obj_material *mtl)
 	mtl->texture_filename[0] = '\0';
 }
 
-int obj_parse_vertex_index(int *vertex_index, int *texture_index, int *normal_index)
+// parses one "v", "v/vt", "v//vn" or "v/vt/vn" element, indices are left at 0 if absent
+const char* obj_parse_corner(const char *p, const char *end, int *vertex_index, int *texture_index, int *normal_index)
 {
-	char *temp_str;
-	char *token;
-	int vertex_count = 0;
+	*vertex_index = 0;
+	*texture_index = 0;
+	*normal_index = 0;
 
-	
-	while( (token = strtok(NULL, WHITESPACE)) != NULL)
+	p = obj_parse_int(p, end, vertex_index);
+	if(p < end && *p == '/')
 	{
-		if(texture_index != NULL)
-			texture_index[vertex_count] = 0;
-		if(normal_index != NULL)
-		normal_index[vertex_count] = 0;
+		p++;
+		if(p < end && *p != '/')
+			p = obj_parse_int(p, end, texture_index);
+		if(p < end && *p == '/')
+			p = obj_parse_int(p + 1, end, normal_index);
+	}
 
-		vertex_index[vertex_count] = atoi( token );
-		
-		if(contains(token, "//"))  //normal only
-		{
-			temp_str = strchr(token, '/');
-			temp_str++;
-			normal_index[vertex_count] = atoi( ++temp_str );
-		}
-		else if(contains(token, "/"))
-		{
-			temp_str = strchr(token, '/');
-			texture_index[vertex_count] = atoi( ++temp_str );
+	return obj_token_end(p, end);
+}
 
-			if(contains(temp_str, "/"))
-			{
-				temp_str = strchr(temp_str, '/');
-				normal_index[vertex_count] = atoi( ++temp_str );
-			}
-		}
-		
-		vertex_count++;
+const char* obj_parse_vertex_index(const char *p, const char *end, int *vertex_index, int *texture_index, int *normal_index, int *vertex_count)
+{
+	int v, vt, vn;
+
+	*vertex_count = 0;
+	memset(vertex_index, 0, sizeof(int) * MAX_VERTEX_COUNT);
+	if(texture_index != NULL)
+		memset(texture_index, 0, sizeof(int) * MAX_VERTEX_COUNT);
+	if(normal_index != NULL)
+		memset(normal_index, 0, sizeof(int) * MAX_VERTEX_COUNT);
+
+	for(p = obj_skip_space(p, end); p < end && *p != '\n'; p = obj_skip_space(p, end))
+	{
+		p = obj_parse_corner(p, end, &v, &vt, &vn);
+		if(*vertex_count == MAX_VERTEX_COUNT)
+			continue;
+
+		vertex_index[*vertex_count] = v;
+		if(texture_index != NULL)
+			texture_index[*vertex_count] = vt;
+		if(normal_index != NULL)
+			normal_index[*vertex_count] = vn;
+		(*vertex_count)++;
 	}
 
-	return vertex_count;
+	return p;
 }
 
-obj_face* obj_parse_face(obj_growable_scene_data *scene)
+const char* obj_parse_face(const char *p, const char *end, obj_growable_scene_data *scene, int material_index)
 {
-	int vertex_count;
-	obj_face *face = (obj_face*)malloc(sizeof(obj_face));
-	
-	vertex_count = obj_parse_vertex_index(face->vertex_index, face->texture_index, face->normal_index);
-	obj_convert_to_list_index_v(scene->vertex_list.item_count, face->vertex_index);
-	obj_convert_to_list_index_v(scene->vertex_texture_list.item_count, face->texture_index);
-	obj_convert_to_list_index_v(scene->vertex_normal_list.item_count, face->normal_index);
-	face->vertex_count = vertex_count;
-	return face;
+	obj_polygon *polygon = (obj_polygon*) obj_array_push(&scene->polygons, 1);
+	int v, vt, vn;
+	int *corner;
+
+	if(polygon == NULL)
+		return NULL;
+	polygon->first_corner = scene->corners.count / 3;
+	polygon->corner_count = 0;
+	polygon->material_index = material_index;
+
+	for(p = obj_skip_space(p, end); p < end && *p != '\n'; p = obj_skip_space(p, end))
+	{
+		p = obj_parse_corner(p, end, &v, &vt, &vn);
+
+		corner = (int*) obj_array_push(&scene->corners, 3);
+		if(corner == NULL)
+			return NULL;
+		// a corner needs its position, a bad texture coordinate or normal is left out
+		corner[0] = obj_resolve_index(scene->positions.count / 3, v);
+		corner[1] = obj_resolve_index(scene->texcoords.count / 2, vt);
+		corner[2] = obj_resolve_index(scene->normals.count / 3, vn);
+		if(corner[0] < 0)
+			return NULL;
+		polygon->corner_count++;
+	}
+
+	return p;
 }
 
-obj_sphere* obj_parse_sphere(obj_growable_scene_data *scene)
+const char* obj_parse_sphere(const char *p, const char *end, obj_growable_scene_data *scene, obj_sphere **out)
 {
 	int temp_indices[MAX_VERTEX_COUNT];
+	int vertex_count;
 
 	obj_sphere *obj = (obj_sphere*)malloc(sizeof(obj_sphere));
-	obj_parse_vertex_index(temp_indices, obj->texture_index, NULL);
-	obj_convert_to_list_index_v(scene->vertex_texture_list.item_count, obj->texture_index);
-	obj->pos_index = obj_convert_to_list_index(scene->vertex_list.item_count, temp_indices[0]);
-	obj->up_normal_index = obj_convert_to_list_index(scene->vertex_normal_list.item_count, temp_indices[1]);
-	obj->equator_normal_index = obj_convert_to_list_index(scene->vertex_normal_list.item_count, temp_indices[2]);
+	p = obj_parse_vertex_index(p, end, temp_indices, obj->texture_index, NULL, &vertex_count);
+	obj_convert_to_list_index_v(scene->texcoords.count / 2, obj->texture_index);
+	obj->pos_index = obj_convert_to_list_index(scene->positions.count / 3, temp_indices[0]);
+	obj->up_normal_index = obj_convert_to_list_index(scene->normals.count / 3, temp_indices[1]);
+	obj->equator_normal_index = obj_convert_to_list_index(scene->normals.count / 3, temp_indices[2]);
 
-	return obj;
+	*out = obj;
+	return p;
 }
 
-obj_plane* obj_parse_plane(obj_growable_scene_data *scene)
+const char* obj_parse_plane(const char *p, const char *end, obj_growable_scene_data *scene, obj_plane **out)
 {
 	int temp_indices[MAX_VERTEX_COUNT];
+	int vertex_count;
 
 	obj_plane *obj = (obj_plane*)malloc(sizeof(obj_plane));
-	obj_parse_vertex_index(temp_indices, obj->texture_index, NULL);
-	obj_convert_to_list_index_v(scene->vertex_texture_list.item_count, obj->texture_index);
-	obj->pos_index = obj_convert_to_list_index(scene->vertex_list.item_count, temp_indices[0]);
-	obj->normal_index = obj_convert_to_list_index(scene->vertex_normal_list.item_count, temp_indices[1]);
-	obj->rotation_normal_index = obj_convert_to_list_index(scene->vertex_normal_list.item_count, temp_indices[2]);
+	p = obj_parse_vertex_index(p, end, temp_indices, obj->texture_index, NULL, &vertex_count);
+	obj_convert_to_list_index_v(scene->texcoords.count / 2, obj->texture_index);
+	obj->pos_index = obj_convert_to_list_index(scene->positions.count / 3, temp_indices[0]);
+	obj->normal_index = obj_convert_to_list_index(scene->normals.count / 3, temp_indices[1]);
+	obj->rotation_normal_index = obj_convert_to_list_index(scene->normals.count / 3, temp_indices[2]);
 
-	return obj;
+	*out = obj;
+	return p;
 }
 
-obj_light_point* obj_parse_light_point(obj_growable_scene_data *scene)
+const char* obj_parse_light_point(const char *p, const char *end, obj_growable_scene_data *scene, obj_light_point **out)
 {
+	int index;
+
 	obj_light_point *o= (obj_light_point*)malloc(sizeof(obj_light_point));
-	o->pos_index = obj_convert_to_list_index(scene->vertex_list.item_count, atoi( strtok(NULL, WHITESPACE)) );
-	return o;
+	p = obj_parse_int(obj_skip_space(p, end), end, &index);
+	o->pos_index = obj_convert_to_list_index(scene->positions.count / 3, index);
+
+	*out = o;
+	return p;
 }
 
-obj_light_quad* obj_parse_light_quad(obj_growable_scene_data *scene)
+const char* obj_parse_light_quad(const char *p, const char *end, obj_growable_scene_data *scene, obj_light_quad **out)
 {
+	int vertex_count;
+
 	obj_light_quad *o = (obj_light_quad*)malloc(sizeof(obj_light_quad));
-	obj_parse_vertex_index(o->vertex_index, NULL, NULL);
-	obj_convert_to_list_index_v(scene->vertex_list.item_count, o->vertex_index);
+	p = obj_parse_vertex_index(p, end, o->vertex_index, NULL, NULL, &vertex_count);
+	obj_convert_to_list_index_v(scene->positions.count / 3, o->vertex_index);
 
-	return o;
+	*out = o;
+	return p;
 }
 
-obj_light_disc* obj_parse_light_disc(obj_growable_scene_data *scene)
+const char* obj_parse_light_disc(const char *p, const char *end, obj_growable_scene_data *scene, obj_light_disc **out)
 {
 	int temp_indices[MAX_VERTEX_COUNT];
+	int vertex_count;
 
 	obj_light_disc *obj = (obj_light_disc*)malloc(sizeof(obj_light_disc));
-	obj_parse_vertex_index(temp_indices, NULL, NULL);
-	obj->pos_index = obj_convert_to_list_index(scene->vertex_list.item_count, temp_indices[0]);
-	obj->normal_index = obj_convert_to_list_index(scene->vertex_normal_list.item_count, temp_indices[1]);
+	p = obj_parse_vertex_index(p, end, temp_indices, NULL, NULL, &vertex_count);
+	obj->pos_index = obj_convert_to_list_index(scene->positions.count / 3, temp_indices[0]);
+	obj->normal_index = obj_convert_to_list_index(scene->normals.count / 3, temp_indices[1]);
 
-	return obj;
+	*out = obj;
+	return p;
 }
 
-obj_tvector* obj_parse_tvector() {
-	obj_tvector *v = (obj_tvector*)malloc(sizeof(obj_tvector));
-	v->t[0] = atof( strtok(NULL, WHITESPACE));
-	v->t[1] = atof( strtok(NULL, WHITESPACE));
-	return v;
+const char* obj_parse_vector(const char *p, const char *end, obj_array *array, int components)
+{
+	float *v = (float*) obj_array_push(array, components);
+	int i;
+
+	if(v == NULL)
+		return NULL;
+	for(i=0; i<components; i++)
+		p = obj_parse_float(p, end, &v[i]);
+	return p;
 }
 
-obj_vector* obj_parse_vector()
+const char* obj_parse_camera(const char *p, const char *end, obj_growable_scene_data *scene, obj_camera *camera)
 {
-	obj_vector *v = (obj_vector*)malloc(sizeof(obj_vector));
-	v->e[0] = atof( strtok(NULL, WHITESPACE));
-	v->e[1] = atof( strtok(NULL, WHITESPACE));
-	v->e[2] = atof( strtok(NULL, WHITESPACE));
-	return v;
+	int indices[MAX_VERTEX_COUNT];
+	int vertex_count;
+
+	p = obj_parse_vertex_index(p, end, indices, NULL, NULL, &vertex_count);
+	camera->camera_pos_index = obj_convert_to_list_index(scene->positions.count / 3, indices[0]);
+	camera->camera_look_point_index = obj_convert_to_list_index(scene->positions.count / 3, indices[1]);
+	camera->camera_up_norm_index = obj_convert_to_list_index(scene->normals.count / 3, indices[2]);
+	return p;
 }
 
-void obj_parse_camera(obj_growable_scene_data *scene, obj_camera *camera)
+const char* obj_parse_double_v(const char *p, const char *end, double *v, int components)
 {
-	int indices[3];
-	obj_parse_vertex_index(indices, NULL, NULL);
-	camera->camera_pos_index = obj_convert_to_list_index(scene->vertex_list.item_count, indices[0]);
-	camera->camera_look_point_index = obj_convert_to_list_index(scene->vertex_list.item_count, indices[1]);
-	camera->camera_up_norm_index = obj_convert_to_list_index(scene->vertex_normal_list.item_count, indices[2]);
+	float value;
+	int i;
+
+	for(i=0; i<components; i++)
+	{
+		p = obj_parse_float(p, end, &value);
+		v[i] = value;
+	}
+	return p;
 }
 
+// reentrant, so materials can be loaded from several threads at once
 int obj_parse_mtl_file(char *filename, list *material_list)
 {
+	const char *buffer;
+	const char *p;
+	const char *end;
+	const char *token;
+	const char *token_end;
+	size_t size;
 	int line_number = 0;
-	char *current_token;
-	char current_line[OBJ_LINE_SIZE];
 	char material_open = 0;
 	obj_material *current_mtl = NULL;
-	FILE *mtl_file_stream;
 	
-	// open scene
-	mtl_file_stream = fopen( filename, "r");
-	if(mtl_file_stream == 0)
+	// map material file
+	buffer = obj_map_file(filename, &size);
+	if(buffer == NULL)
 	{
 		fprintf(stderr, "Error reading file: %s\n", filename);
 		return 0;
 	}
-		
-	list_make(material_list, 10, 1);
+	end = buffer + size;
 
-	while( fgets(current_line, OBJ_LINE_SIZE, mtl_file_stream) )
+	for(p = buffer; p < end; p = obj_skip_line(p, end))
 	{
-		current_token = strtok( current_line, " \t\n\r");
+		token = obj_skip_space(p, end);
+		token_end = obj_token_end(token, end);
+		p = token_end;
 		line_number++;
 		
 		//skip comments
-		if( current_token == NULL || strequal(current_token, "//") || strequal(current_token, "#"))
+		if( token == token_end || obj_token_equal(token, token_end, "//") || token[0] == '#')
 			continue;
 		
 
 		//start material
-		else if( strequal(current_token, "newmtl"))
+		else if( obj_token_equal(token, token_end, "newmtl"))
 		{
 			material_open = 1;
 			current_mtl = (obj_material*) malloc(sizeof(obj_material));
 			obj_set_material_defaults(current_mtl);
 			
 			// get the name
-			strncpy(current_mtl->name, strtok(NULL, " \t"), MATERIAL_NAME_SIZE);
+			p = obj_copy_token(p, end, current_mtl->name, MATERIAL_NAME_SIZE);
 			list_add_item(material_list, current_mtl, current_mtl->name);
 		}
 		
 		//ambient
-		else if( strequal(current_token, "Ka") && material_open)
+		else if( obj_token_equal(token, token_end, "Ka") && material_open)
 		{
-			current_mtl->amb[0] = atof( strtok(NULL, " \t"));
-			current_mtl->amb[1] = atof( strtok(NULL, " \t"));
-			current_mtl->amb[2] = atof( strtok(NULL, " \t"));
+			p = obj_parse_double_v(p, end, current_mtl->amb, 3);
 		}
 
 		//diff
-		else if( strequal(current_token, "Kd") && material_open)
+		else if( obj_token_equal(token, token_end, "Kd") && material_open)
 		{
-			current_mtl->diff[0] = atof( strtok(NULL, " \t"));
-			current_mtl->diff[1] = atof( strtok(NULL, " \t"));
-			current_mtl->diff[2] = atof( strtok(NULL, " \t"));
+			p = obj_parse_double_v(p, end, current_mtl->diff, 3);
 		}
 		
 		//specular
-		else if( strequal(current_token, "Ks") && material_open)
+		else if( obj_token_equal(token, token_end, "Ks") && material_open)
 		{
-			current_mtl->spec[0] = atof( strtok(NULL, " \t"));
-			current_mtl->spec[1] = atof( strtok(NULL, " \t"));
-			current_mtl->spec[2] = atof( strtok(NULL, " \t"));
+			p = obj_parse_double_v(p, end, current_mtl->spec, 3);
 		}
 		//shiny
-		else if( strequal(current_token, "Ns") && material_open)
+		else if( obj_token_equal(token, token_end, "Ns") && material_open)
 		{
-			current_mtl->shiny = atof( strtok(NULL, " \t"));
+			p = obj_parse_double_v(p, end, &current_mtl->shiny, 1);
 		}
 		//transparent
-		else if( strequal(current_token, "d") && material_open)
+		else if( obj_token_equal(token, token_end, "d") && material_open)
 		{
-			current_mtl->trans = atof( strtok(NULL, " \t"));
+			p = obj_parse_double_v(p, end, &current_mtl->trans, 1);
 		}
 		//reflection
-		else if( strequal(current_token, "r") && material_open)
+		else if( obj_token_equal(token, token_end, "r") && material_open)
 		{
-			current_mtl->reflect = atof( strtok(NULL, " \t"));
+			p = obj_parse_double_v(p, end, &current_mtl->reflect, 1);
 		}
 		//glossy
-		else if( strequal(current_token, "sharpness") && material_open)
+		else if( obj_token_equal(token, token_end, "sharpness") && material_open)
 		{
-			current_mtl->glossy = atof( strtok(NULL, " \t"));
+			p = obj_parse_double_v(p, end, &current_mtl->glossy, 1);
 		}
 		//refract index
-		else if( strequal(current_token, "Ni") && material_open)
+		else if( obj_token_equal(token, token_end, "Ni") && material_open)
 		{
-			current_mtl->refract_index = atof( strtok(NULL, " \t"));
+			p = obj_parse_double_v(p, end, &current_mtl->refract_index, 1);
 		}
 		// illumination type
-		else if( strequal(current_token, "illum") && material_open)
+		else if( obj_token_equal(token, token_end, "illum") && material_open)
 		{
 		}
 		// texture map
-		else if( strequal(current_token, "map_Ka") && material_open)
+		else if( obj_token_equal(token, token_end, "map_Ka") && material_open)
 		{
-			strncpy(current_mtl->texture_filename, strtok(NULL, " \t"), OBJ_FILENAME_LENGTH);
+			p = obj_copy_token(p, end, current_mtl->texture_filename, OBJ_FILENAME_LENGTH);
 		}
 		else
 		{
-			fprintf(stderr, "Unknown command '%s' in material file %s at line %i:\n\t%s\n",
-					current_token, filename, line_number, current_line);
+			fprintf(stderr, "Unknown command '%.*s' in material file %s at line %i:\n\t%.*s\n",
+					(int)(token_end - token), token, filename, line_number,
+					(int)(obj_token_end(token, end) - token), token);
 			//return 0;
 		}
 	}
 	
-	fclose(mtl_file_stream);
+	obj_unmap_file(buffer, size);
 
 	return 1;
 
@@ -319,138 +663,145 @@ int obj_parse_mtl_file(char *filename, list *material_list)
 
 int obj_parse_obj_file(obj_growable_scene_data *growable_data, char *filename)
 {
-
-	FILE* obj_file_stream;
+	const char *buffer;
+	const char *p;
+	const char *end;
+	const char *token;
+	const char *token_end;
+	size_t size;
 	int current_material = -1; 
-	char *current_token = NULL;
-	char current_line[OBJ_LINE_SIZE];
+	char name[OBJ_FILENAME_LENGTH];
 	int line_number = 0;
-	// open scene
-	obj_file_stream = fopen( filename, "r");
-	if(obj_file_stream == 0)
+
+	// map scene
+	buffer = obj_map_file(filename, &size);
+	if(buffer == NULL)
 	{
 		fprintf(stderr, "Error reading file: %s\n", filename);
 		return 0;
 	}
+	end = buffer + size;
 
-/*		
-	extreme_dimensions[0].x = INFINITY; extreme_dimensions[0].y = INFINITY; extreme_dimensions[0].z = INFINITY;
-	extreme_dimensions[1].x = -INFINITY; extreme_dimensions[1].y = -INFINITY; extreme_dimensions[1].z = -INFINITY;
-
-			if(v->x < extreme_dimensions[0].x) extreme_dimensions[0].x = v->x;
-			if(v->x > extreme_dimensions[1].x) extreme_dimensions[1].x = v->x;
-			if(v->y < extreme_dimensions[0].y) extreme_dimensions[0].y = v->y;
-			if(v->y > extreme_dimensions[1].y) extreme_dimensions[1].y = v->y;
-			if(v->z < extreme_dimensions[0].z) extreme_dimensions[0].z = v->z;
-			if(v->z > extreme_dimensions[1].z) extreme_dimensions[1].z = v->z;*/
-
-
-	//parser loop
-	while( fgets(current_line, OBJ_LINE_SIZE, obj_file_stream) )
+	//parser loop, every branch leaves p somewhere on the current line
+	for(p = buffer; p < end; p = obj_skip_line(p, end))
 	{
-		current_token = strtok( current_line, " \t\n\r");
+		token = obj_skip_space(p, end);
+		token_end = obj_token_end(token, end);
+		p = token_end;
 		line_number++;
 		
 		//skip comments
-		if( current_token == NULL || current_token[0] == '#')
+		if( token == token_end || token[0] == '#')
 			continue;
 
 		//parse objects
-		else if( strequal(current_token, "v") ) //process vertex
+		else if( obj_token_equal(token, token_end, "v") ) //process vertex
 		{
-			list_add_item(&growable_data->vertex_list,  obj_parse_vector(), NULL);
+			p = obj_parse_vector(p, end, &growable_data->positions, 3);
 		}
 		
-		else if( strequal(current_token, "vn") ) //process vertex normal
+		else if( obj_token_equal(token, token_end, "vn") ) //process vertex normal
 		{
-			list_add_item(&growable_data->vertex_normal_list,  obj_parse_vector(), NULL);
+			p = obj_parse_vector(p, end, &growable_data->normals, 3);
 		}
 		
-		else if( strequal(current_token, "vt") ) //process vertex texture
+		else if( obj_token_equal(token, token_end, "vt") ) //process vertex texture
 		{
-			list_add_item(&growable_data->vertex_texture_list,  obj_parse_tvector(), NULL);
+			p = obj_parse_vector(p, end, &growable_data->texcoords, 2);
 		}
 		
-		else if( strequal(current_token, "f") ) //process face
+		else if( obj_token_equal(token, token_end, "f") ) //process face
 		{
-			obj_face *face = obj_parse_face(growable_data);
-			face->material_index = current_material;
-			list_add_item(&growable_data->face_list, face, NULL);
+			p = obj_parse_face(p, end, growable_data, current_material);
 		}
 		
-		else if( strequal(current_token, "sp") ) //process sphere
+		else if( obj_token_equal(token, token_end, "sp") ) //process sphere
 		{
-			obj_sphere *sphr = obj_parse_sphere(growable_data);
+			obj_sphere *sphr;
+			p = obj_parse_sphere(p, end, growable_data, &sphr);
 			sphr->material_index = current_material;
 			list_add_item(&growable_data->sphere_list, sphr, NULL);
 		}
 		
-		else if( strequal(current_token, "pl") ) //process plane
+		else if( obj_token_equal(token, token_end, "pl") ) //process plane
 		{
-			obj_plane *pl = obj_parse_plane(growable_data);
+			obj_plane *pl;
+			p = obj_parse_plane(p, end, growable_data, &pl);
 			pl->material_index = current_material;
 			list_add_item(&growable_data->plane_list, pl, NULL);
 		}
 		
-		else if( strequal(current_token, "p") ) //process point
+		else if( obj_token_equal(token, token_end, "p") ) //process point
 		{
 			//make a small sphere to represent the point?
 		}
 		
-		else if( strequal(current_token, "lp") ) //light point source
+		else if( obj_token_equal(token, token_end, "lp") ) //light point source
 		{
-			obj_light_point *o = obj_parse_light_point(growable_data);
+			obj_light_point *o;
+			p = obj_parse_light_point(p, end, growable_data, &o);
 			o->material_index = current_material;
 			list_add_item(&growable_data->light_point_list, o, NULL);
 		}
 		
-		else if( strequal(current_token, "ld") ) //process light disc
+		else if( obj_token_equal(token, token_end, "ld") ) //process light disc
 		{
-			obj_light_disc *o = obj_parse_light_disc(growable_data);
+			obj_light_disc *o;
+			p = obj_parse_light_disc(p, end, growable_data, &o);
 			o->material_index = current_material;
 			list_add_item(&growable_data->light_disc_list, o, NULL);
 		}
 		
-		else if( strequal(current_token, "lq") ) //process light quad
+		else if( obj_token_equal(token, token_end, "lq") ) //process light quad
 		{
-			obj_light_quad *o = obj_parse_light_quad(growable_data);
+			obj_light_quad *o;
+			p = obj_parse_light_quad(p, end, growable_data, &o);
 			o->material_index = current_material;
 			list_add_item(&growable_data->light_quad_list, o, NULL);
 		}
 		
-		else if( strequal(current_token, "c") ) //camera
+		else if( obj_token_equal(token, token_end, "c") ) //camera
 		{
 			growable_data->camera = (obj_camera*) malloc(sizeof(obj_camera));
-			obj_parse_camera(growable_data, growable_data->camera);
+			p = obj_parse_camera(p, end, growable_data, growable_data->camera);
 		}
 		
-		else if( strequal(current_token, "usemtl") ) // usemtl
+		else if( obj_token_equal(token, token_end, "usemtl") ) // usemtl
 		{
-			current_material = list_find(&growable_data->material_list, strtok(NULL, WHITESPACE));
+			p = obj_copy_token(p, end, name, MATERIAL_NAME_SIZE);
+			current_material = list_find(&growable_data->material_list, name);
 		}
 		
-		else if( strequal(current_token, "mtllib") ) // mtllib
+		else if( obj_token_equal(token, token_end, "mtllib") ) // mtllib
 		{
-			strncpy(growable_data->material_filename, strtok(NULL, WHITESPACE), OBJ_FILENAME_LENGTH);
+			p = obj_copy_token(p, end, growable_data->material_filename, OBJ_FILENAME_LENGTH);
 			obj_parse_mtl_file(growable_data->material_filename, &growable_data->material_list);
-			continue;
 		}
 		
-		else if( strequal(current_token, "o") ) //object name
+		else if( obj_token_equal(token, token_end, "o") ) //object name
 		{ }
-		else if( strequal(current_token, "s") ) //smoothing
+		else if( obj_token_equal(token, token_end, "s") ) //smoothing
 		{ }
-		else if( strequal(current_token, "g") ) // group
+		else if( obj_token_equal(token, token_end, "g") ) // group
 		{ }		
 
 		else
 		{
-			printf("Unknown command '%s' in scene code at line %i: \"%s\".\n",
-					current_token, line_number, current_line);
+			printf("Unknown command '%.*s' in scene code at line %i: \"%.*s\".\n",
+					(int)(token_end - token), token, line_number,
+					(int)(obj_skip_line(token, end) - token), token);
+		}
+
+		//the vertex and face parsers return NULL when out of memory, faces also for a bad vertex index
+		if(p == NULL)
+		{
+			fprintf(stderr, "Out of memory or vertex index out of range at line %i of %s\n", line_number, filename);
+			obj_unmap_file(buffer, size);
+			return 0;
 		}
 	}
 
-	fclose(obj_file_stream);
+	obj_unmap_file(buffer, size);
 	
 	return 1;
 }
@@ -458,11 +809,12 @@ int obj_parse_obj_file(obj_growable_scene_data *growable_data, char *filename)
 
 void obj_init_temp_storage(obj_growable_scene_data *growable_data)
 {
-	list_make(&growable_data->vertex_list, 10, 1);
-	list_make(&growable_data->vertex_normal_list, 10, 1);
-	list_make(&growable_data->vertex_texture_list, 10, 1);
+	obj_array_make(&growable_data->positions, sizeof(float));
+	obj_array_make(&growable_data->normals, sizeof(float));
+	obj_array_make(&growable_data->texcoords, sizeof(float));
 	
-	list_make(&growable_data->face_list, 10, 1);
+	obj_array_make(&growable_data->corners, sizeof(int));
+	obj_array_make(&growable_data->polygons, sizeof(obj_polygon));
 	list_make(&growable_data->sphere_list, 10, 1);
 	list_make(&growable_data->plane_list, 10, 1);
 	
@@ -472,16 +824,18 @@ void obj_init_temp_storage(obj_growable_scene_data *growable_data)
 	
 	list_make(&growable_data->material_list, 10, 1);	
 	
+	growable_data->material_filename[0] = '\0';
 	growable_data->camera = NULL;
 }
 
 void obj_free_temp_storage(obj_growable_scene_data *growable_data)
 {
-	obj_free_half_list(&growable_data->vertex_list);
-	obj_free_half_list(&growable_data->vertex_normal_list);
-	obj_free_half_list(&growable_data->vertex_texture_list);
+	obj_array_free(&growable_data->positions);
+	obj_array_free(&growable_data->normals);
+	obj_array_free(&growable_data->texcoords);
 	
-	obj_free_half_list(&growable_data->face_list);
+	obj_array_free(&growable_data->corners);
+	obj_array_free(&growable_data->polygons);
 	obj_free_half_list(&growable_data->sphere_list);
 	obj_free_half_list(&growable_data->plane_list);
 	
@@ -496,18 +850,11 @@ void delete_obj_data(obj_scene_data *data_out)
 {
 	int i;
 	
-	for(i=0; i<data_out->vertex_count; i++)
-		free(data_out->vertex_list[i]);
+	// vertices and faces live in the same block as their pointer list
 	free(data_out->vertex_list);
-	for(i=0; i<data_out->vertex_normal_count; i++)
-		free(data_out->vertex_normal_list[i]);
 	free(data_out->vertex_normal_list);
-	for(i=0; i<data_out->vertex_texture_count; i++)
-		free(data_out->vertex_texture_list[i]);
 	free(data_out->vertex_texture_list);
 
-	for(i=0; i<data_out->face_count; i++)
-		free(data_out->face_list[i]);
 	free(data_out->face_list);
 	for(i=0; i<data_out->sphere_count; i++)
 		free(data_out->sphere_list[i]);
@@ -533,13 +880,74 @@ void delete_obj_data(obj_scene_data *data_out)
 	free(data_out->camera);
 }
 
+// allocates a pointer list followed by the items it points to, so one free releases both
+void** obj_make_pointer_list(int count, int item_size)
+{
+	void **pointers = (void**) malloc(count * (sizeof(void*) + item_size) + 1);
+	char *items = (char*)(pointers + count);
+	int i;
+
+	for(i=0; i<count; i++)
+		pointers[i] = items + (size_t)i * item_size;
+	return pointers;
+}
+
+void obj_copy_vectors(obj_vector **vectors, obj_array *array)
+{
+	float *v = (float*) array->items;
+	int i;
+
+	for(i=0; i<array->count / 3; i++)
+	{
+		vectors[i]->e[0] = v[i*3];
+		vectors[i]->e[1] = v[i*3+1];
+		vectors[i]->e[2] = v[i*3+2];
+	}
+}
+
+void obj_copy_faces(obj_face **faces, obj_growable_scene_data *growable_data)
+{
+	obj_polygon *polygons = (obj_polygon*) growable_data->polygons.items;
+	int *corners = (int*) growable_data->corners.items;
+	int *corner;
+	int i, j;
+
+	for(i=0; i<growable_data->polygons.count; i++)
+	{
+		obj_face *face = faces[i];
+
+		face->vertex_count = polygons[i].corner_count;
+		if(face->vertex_count > MAX_VERTEX_COUNT)
+			face->vertex_count = MAX_VERTEX_COUNT;
+		face->material_index = polygons[i].material_index;
+
+		for(j=0; j<MAX_VERTEX_COUNT; j++)
+		{
+			face->vertex_index[j] = -1;
+			face->texture_index[j] = -1;
+			face->normal_index[j] = -1;
+		}
+
+		for(j=0; j<face->vertex_count; j++)
+		{
+			corner = corners + (polygons[i].first_corner + j) * 3;
+			face->vertex_index[j] = corner[0];
+			face->texture_index[j] = corner[1];
+			face->normal_index[j] = corner[2];
+		}
+	}
+}
+
 void obj_copy_to_out_storage(obj_scene_data *data_out, obj_growable_scene_data *growable_data)
 {
-	data_out->vertex_count = growable_data->vertex_list.item_count;
-	data_out->vertex_normal_count = growable_data->vertex_normal_list.item_count;
-	data_out->vertex_texture_count = growable_data->vertex_texture_list.item_count;
+	float *uv = (float*) growable_data->texcoords.items;
+	int i;
+
+	data_out->vertex_count = growable_data->positions.count / 3;
+	data_out->vertex_normal_count = growable_data->normals.count / 3;
+	data_out->vertex_texture_count = growable_data->texcoords.count / 2;
 
-	data_out->face_count = growable_data->face_list.item_count;
+	data_out->face_count = growable_data->polygons.count;
 	data_out->sphere_count = growable_data->sphere_list.item_count;
 	data_out->plane_count = growable_data->plane_list.item_count;
 
@@ -549,11 +957,19 @@ void obj_copy_to_out_storage(obj_scene_data *data_out, obj_growable_scene_data *
 
 	data_out->material_count = growable_data->material_list.item_count;
 	
-	data_out->vertex_list = (obj_vector**)growable_data->vertex_list.items;
-	data_out->vertex_normal_list = (obj_vector**)growable_data->vertex_normal_list.items;
-	data_out->vertex_texture_list = (obj_tvector**)growable_data->vertex_texture_list.items;
+	data_out->vertex_list = (obj_vector**) obj_make_pointer_list(data_out->vertex_count, sizeof(obj_vector));
+	data_out->vertex_normal_list = (obj_vector**) obj_make_pointer_list(data_out->vertex_normal_count, sizeof(obj_vector));
+	data_out->vertex_texture_list = (obj_tvector**) obj_make_pointer_list(data_out->vertex_texture_count, sizeof(obj_tvector));
+	obj_copy_vectors(data_out->vertex_list, &growable_data->positions);
+	obj_copy_vectors(data_out->vertex_normal_list, &growable_data->normals);
+	for(i=0; i<data_out->vertex_texture_count; i++)
+	{
+		data_out->vertex_texture_list[i]->t[0] = uv[i*2];
+		data_out->vertex_texture_list[i]->t[1] = uv[i*2+1];
+	}
 
-	data_out->face_list = (obj_face**)growable_data->face_list.items;
+	data_out->face_list = (obj_face**) obj_make_pointer_list(data_out->face_count, sizeof(obj_face));
+	obj_copy_faces(data_out->face_list, growable_data);
 	data_out->sphere_list = (obj_sphere**)growable_data->sphere_list.items;
 	data_out->plane_list = (obj_plane**)growable_data->plane_list.items;
 
@@ -566,16 +982,417 @@ void obj_copy_to_out_storage(obj_scene_data *data_out, obj_growable_scene_data *
 	data_out->camera = growable_data->camera;
 }
 
+// releases the temporary storage including the parsed items, used when nothing is handed out
+void obj_free_all_storage(obj_growable_scene_data *growable_data)
+{
+	list *lists[] = {
+		&growable_data->sphere_list, &growable_data->plane_list,
+		&growable_data->light_point_list, &growable_data->light_quad_list,
+		&growable_data->light_disc_list, &growable_data->material_list
+	};
+	int i, j;
+
+	obj_array_free(&growable_data->positions);
+	obj_array_free(&growable_data->normals);
+	obj_array_free(&growable_data->texcoords);
+	obj_array_free(&growable_data->corners);
+	obj_array_free(&growable_data->polygons);
+
+	for(i=0; i<(int)(sizeof(lists)/sizeof(lists[0])); i++)
+	{
+		for(j=0; j<lists[i]->item_count; j++)
+			free(lists[i]->items[j]);
+		list_free(lists[i]);
+	}
+
+	free(growable_data->camera);
+}
+
 int parse_obj_scene(obj_scene_data *data_out, char *filename)
 {
 	obj_growable_scene_data growable_data;
 
 	obj_init_temp_storage(&growable_data);
 	if( obj_parse_obj_file(&growable_data, filename) == 0)
+	{
+		obj_free_all_storage(&growable_data);
 		return 0;
+	}
 	
 	obj_copy_to_out_storage(data_out, &growable_data);
 	obj_free_temp_storage(&growable_data);
 	return 1;
 }
 
+/******************************************************************
+*
+* obj_pack_mesh
+*
+* Splits the welded vertices for 16 bit indices if requested and
+* needed, packs the indices and copies everything into the block of
+* mesh_out; vertex_count, triangle_count and material_count must be
+* set, the materials are left for the caller to fill in. The first
+* triangle_count * 3 indices are the full mesh, index_count may
+* include coarser levels of detail behind them, which are only
+* allowed if no split is needed
+*
+*******************************************************************/
+
+int obj_pack_mesh(obj_mesh *mesh_out, mesh_vertex *vertices, unsigned int *indices, int index_count, int flags)
+{
+	mesh_vertex *split_vertices = NULL;
+	mesh_chunk *chunks = NULL;
+	mesh_chunk single_chunk;
+	size_t vertices_size, indices_size, chunks_size, materials_size;
+	int largest_chunk = 0;
+	int i;
+
+	mesh_out->block = NULL;
+	mesh_out->mapping = NULL;
+	mesh_out->mapping_size = 0;
+	mesh_out->chunk_count = -1;
+	mesh_out->index_count = index_count;
+	mesh_out->flags = flags;
+
+	if((flags & MESH_SPLIT_16BIT) && mesh_out->vertex_count > MESH_MAX_16BIT_VERTICES)
+	{
+		split_vertices = (mesh_vertex*) malloc(sizeof(mesh_vertex) * (index_count + 1));
+		chunks = (mesh_chunk*) malloc(sizeof(mesh_chunk) * (mesh_out->triangle_count + 1));
+		if(split_vertices != NULL && chunks != NULL)
+		{
+			mesh_out->chunk_count = mesh_split(vertices, mesh_out->vertex_count, indices, mesh_out->triangle_count,
+					MESH_MAX_16BIT_VERTICES, split_vertices, chunks, &mesh_out->vertex_count);
+			vertices = split_vertices;
+		}
+	}
+	else
+	{
+		single_chunk.first_index = 0;
+		single_chunk.index_count = mesh_out->triangle_count * 3;
+		single_chunk.base_vertex = 0;
+		single_chunk.vertex_count = mesh_out->vertex_count;
+		chunks = &single_chunk;
+		mesh_out->chunk_count = 1;
+	}
+
+	if(mesh_out->chunk_count >= 0)
+	{
+		for(i=0; i<mesh_out->chunk_count; i++)
+		{
+			if(chunks[i].vertex_count > largest_chunk)
+				largest_chunk = chunks[i].vertex_count;
+		}
+		mesh_out->index_size = mesh_index_size(largest_chunk);
+		mesh_pack_indices(indices, index_count, mesh_out->index_size, indices);
+
+		vertices_size = obj_align(mesh_out->vertex_count * sizeof(mesh_vertex));
+		indices_size = obj_align(index_count * mesh_out->index_size);
+		chunks_size = obj_align(mesh_out->chunk_count * sizeof(mesh_chunk));
+		materials_size = obj_align(mesh_out->material_count * sizeof(obj_material));
+		mesh_out->block_size = vertices_size + indices_size + chunks_size + materials_size;
+		mesh_out->block = obj_aligned_alloc(mesh_out->block_size + OBJ_ALIGNMENT);
+	}
+
+	if(mesh_out->block != NULL)
+	{
+		mesh_out->vertices = (mesh_vertex*) mesh_out->block;
+		mesh_out->indices = (char*)mesh_out->block + vertices_size;
+		mesh_out->chunks = (mesh_chunk*)((char*)mesh_out->indices + indices_size);
+		mesh_out->materials = (obj_material*)((char*)mesh_out->chunks + chunks_size);
+
+		memcpy(mesh_out->vertices, vertices, mesh_out->vertex_count * sizeof(mesh_vertex));
+		memcpy(mesh_out->indices, indices, index_count * mesh_out->index_size);
+		memcpy(mesh_out->chunks, chunks, mesh_out->chunk_count * sizeof(mesh_chunk));
+		mesh_compute_bounds(mesh_out->vertices, mesh_out->vertex_count, &mesh_out->bounds);
+	}
+
+	if(chunks != &single_chunk)
+		free(chunks);
+	free(split_vertices);
+	return mesh_out->block != NULL;
+}
+
+/******************************************************************
+*
+* obj_build_lods
+*
+* Appends coarser levels of detail to the full index buffer of
+* mesh_out, each simplified from the previous one to half its
+* triangles; stops early when a level would exceed the error limit
+* or barely shrink. The errors add up from level to level. Grows
+* *indices as needed and returns the total index count
+*
+*******************************************************************/
+
+int obj_build_lods(obj_mesh *mesh_out, const mesh_vertex *vertices, unsigned int **indices)
+{
+	mesh_bounds bounds;
+	int index_count = mesh_out->lods[0].index_count;
+	int capacity = index_count;
+	unsigned int *grown = *indices;
+	float max_error, error;
+
+	mesh_compute_bounds(vertices, mesh_out->vertex_count, &bounds);
+	max_error = MESH_LOD_MAX_ERROR * bounds.radius;
+
+	while(mesh_out->lod_count < MESH_MAX_LODS)
+	{
+		mesh_lod *previous = mesh_out->lods + mesh_out->lod_count - 1;
+		mesh_lod *lod = mesh_out->lods + mesh_out->lod_count;
+		int target = previous->index_count / 6 * 3;
+
+		// mesh_simplify copies the whole previous level to the output before it shrinks it
+		if(index_count + previous->index_count > capacity)
+		{
+			capacity = index_count + previous->index_count;
+			if(capacity < index_count * 2)
+				capacity = index_count * 2;
+			grown = (unsigned int*) realloc(*indices, sizeof(unsigned int) * (capacity + 1));
+			if(grown == NULL)
+				break;
+			*indices = grown;
+		}
+
+		lod->first_index = index_count;
+		lod->index_count = mesh_simplify(vertices, mesh_out->vertex_count, grown + previous->first_index, previous->index_count,
+				target, max_error - previous->error, grown + index_count, &error);
+
+		if(lod->index_count <= 0 || lod->index_count > previous->index_count * 3 / 4)
+			break;
+
+		mesh_optimize_vertex_cache(grown + index_count, lod->index_count / 3, mesh_out->vertex_count);
+		lod->error = previous->error + error;
+		index_count += lod->index_count;
+		mesh_out->lod_count++;
+	}
+
+	return index_count;
+}
+
+int obj_copy_to_mesh(obj_mesh *mesh_out, obj_growable_scene_data *growable_data, int flags)
+{
+	obj_polygon *polygons = (obj_polygon*) growable_data->polygons.items;
+	int *polygon_corners = (int*) growable_data->corners.items;
+	int corner_count = 0;
+	int largest_polygon = 0;
+	mesh_corner *corners;
+	mesh_vertex *vertices;
+	unsigned int *indices;
+	int *position_indices, *triangles, *work;
+	int index_count;
+	int i, j;
+
+	for(i=0; i<growable_data->polygons.count; i++)
+	{
+		if(polygons[i].corner_count >= 3)
+			corner_count += (polygons[i].corner_count - 2) * 3;
+		if(polygons[i].corner_count > largest_polygon)
+			largest_polygon = polygons[i].corner_count;
+	}
+
+	corners = (mesh_corner*) malloc(sizeof(mesh_corner) * (corner_count + 1));
+	vertices = (mesh_vertex*) malloc(sizeof(mesh_vertex) * (corner_count + 1));
+	indices = (unsigned int*) malloc(sizeof(unsigned int) * (corner_count + 1));
+	position_indices = (int*) malloc(sizeof(int) * (largest_polygon * 5 + 1));
+	triangles = position_indices + largest_polygon;
+	work = triangles + largest_polygon * 3;
+
+	mesh_out->block = NULL;
+	mesh_out->mapping = NULL;
+	mesh_out->mapping_size = 0;
+	mesh_out->vertex_count = -1;
+	mesh_out->triangle_count = corner_count / 3;
+	mesh_out->material_count = growable_data->material_list.item_count;
+	mesh_out->chunk_count = -1;
+	mesh_out->flags = flags;
+	strncpy(mesh_out->material_filename, growable_data->material_filename, OBJ_FILENAME_LENGTH);
+
+	if(corners != NULL && vertices != NULL && indices != NULL && position_indices != NULL)
+	{
+		mesh_corner *out = corners;
+
+		for(i=0; i<growable_data->polygons.count; i++)
+		{
+			int *polygon = polygon_corners + polygons[i].first_corner * 3;
+			int triangle_count;
+
+			// triangles are copied as they are, larger polygons are triangulated
+			if(polygons[i].corner_count == 3)
+			{
+				triangle_count = 1;
+				triangles[0] = 0;
+				triangles[1] = 1;
+				triangles[2] = 2;
+			}
+			else
+			{
+				for(j=0; j<polygons[i].corner_count; j++)
+					position_indices[j] = polygon[j*3];
+				triangle_count = mesh_triangulate_polygon((float*) growable_data->positions.items, position_indices,
+						polygons[i].corner_count, triangles, work);
+			}
+
+			for(j=0; j<triangle_count*3; j++, out++)
+			{
+				int *corner = polygon + triangles[j] * 3;
+
+				out->position = corner[0];
+				out->texcoord = corner[1];
+				out->normal = corner[2];
+				out->material = polygons[i].material_index;
+			}
+		}
+
+		mesh_out->vertex_count = mesh_weld((float*) growable_data->positions.items, (float*) growable_data->normals.items,
+				(float*) growable_data->texcoords.items, corners, corner_count, vertices, indices);
+	}
+
+	if(!(flags & MESH_KEEP_ORDER) && mesh_out->vertex_count >= 0)
+	{
+		mesh_optimize_vertex_cache(indices, mesh_out->triangle_count, mesh_out->vertex_count);
+		mesh_out->vertex_count = mesh_optimize_vertex_fetch(vertices, mesh_out->vertex_count, indices, corner_count);
+	}
+
+	mesh_out->lod_count = 1;
+	mesh_out->lods[0].first_index = 0;
+	mesh_out->lods[0].index_count = corner_count;
+	mesh_out->lods[0].error = 0.0f;
+	index_count = corner_count;
+
+	if(mesh_out->vertex_count >= 0 && !(flags & MESH_NO_LODS) && mesh_out->triangle_count >= MESH_LOD_MIN_TRIANGLES &&
+		!((flags & MESH_SPLIT_16BIT) && mesh_out->vertex_count > MESH_MAX_16BIT_VERTICES))
+	{
+		index_count = obj_build_lods(mesh_out, vertices, &indices);
+	}
+
+	if(mesh_out->vertex_count >= 0 && obj_pack_mesh(mesh_out, vertices, indices, index_count, flags))
+	{
+		for(i=0; i<mesh_out->material_count; i++)
+			mesh_out->materials[i] = *(obj_material*)growable_data->material_list.items[i];
+	}
+
+	free(position_indices);
+	free(indices);
+	free(vertices);
+	free(corners);
+	return mesh_out->block != NULL;
+}
+
+void delete_obj_mesh(obj_mesh *mesh)
+{
+	if(mesh->mapping != NULL)
+		obj_unmap_file(mesh->mapping, mesh->mapping_size);
+	else
+		obj_aligned_free(mesh->block);
+
+	mesh->block = NULL;
+	mesh->mapping = NULL;
+}
+
+int parse_obj_mesh(obj_mesh *mesh_out, char *filename, int flags)
+{
+	obj_growable_scene_data growable_data;
+	int result = 0;
+
+	obj_init_temp_storage(&growable_data);
+	if( obj_parse_obj_file(&growable_data, filename) )
+	{
+		result = obj_copy_to_mesh(mesh_out, &growable_data, flags);
+	}
+
+	obj_free_all_storage(&growable_data);
+	return result;
+}
+
+/******************************************************************
+*
+* merge_obj_meshes
+*
+* Builds one mesh from mesh_count meshes, each pre-transformed by
+* its column major 4x4 matrix in transforms (16 floats per mesh).
+* The materials are concatenated and the material index of every
+* vertex is offset to point into the merged list, so the result can
+* be drawn with a single call; only the full levels of detail are
+* merged
+*
+*******************************************************************/
+
+int merge_obj_meshes(obj_mesh *mesh_out, const obj_mesh *meshes, const float *transforms, int mesh_count, int flags)
+{
+	mesh_vertex *vertices;
+	unsigned int *indices;
+	int vertex_count = 0;
+	int index_count = 0;
+	int material_count = 0;
+	int i, c, k, v;
+
+	for(i=0; i<mesh_count; i++)
+	{
+		vertex_count += meshes[i].vertex_count;
+		index_count += meshes[i].triangle_count * 3;
+		material_count += meshes[i].material_count;
+	}
+
+	vertices = (mesh_vertex*) malloc(sizeof(mesh_vertex) * (vertex_count + 1));
+	indices = (unsigned int*) malloc(sizeof(unsigned int) * (index_count + 1));
+
+	mesh_out->block = NULL;
+	mesh_out->mapping = NULL;
+	mesh_out->mapping_size = 0;
+	mesh_out->chunk_count = -1;
+	mesh_out->vertex_count = vertex_count;
+	mesh_out->triangle_count = index_count / 3;
+	mesh_out->material_count = material_count;
+	mesh_out->lod_count = 1;
+	mesh_out->lods[0].first_index = 0;
+	mesh_out->lods[0].index_count = index_count;
+	mesh_out->lods[0].error = 0.0f;
+	mesh_out->material_filename[0] = '\0';
+
+	if(vertices != NULL && indices != NULL)
+	{
+		int first_vertex = 0;
+		int first_index = 0;
+		int first_material = 0;
+
+		for(i=0; i<mesh_count; i++)
+		{
+			const obj_mesh *mesh = meshes + i;
+
+			memcpy(vertices + first_vertex, mesh->vertices, mesh->vertex_count * sizeof(mesh_vertex));
+			mesh_transform_vertices(vertices + first_vertex, mesh->vertex_count, transforms + i*16);
+			// -1 (no material) stays, it must not turn into the previous mesh's last material
+			for(v=first_vertex; v<first_vertex + mesh->vertex_count; v++)
+			{
+				if(vertices[v].material_index >= 0)
+					vertices[v].material_index += first_material;
+			}
+
+			// chunk indices are relative to the chunk's base vertex
+			for(c=0; c<mesh->chunk_count; c++)
+			{
+				const mesh_chunk *chunk = mesh->chunks + c;
+
+				for(k=0; k<chunk->index_count; k++)
+					indices[first_index++] = first_vertex + chunk->base_vertex +
+							mesh_get_index(mesh->indices, mesh->index_size, chunk->first_index + k);
+			}
+
+			first_vertex += mesh->vertex_count;
+			first_material += mesh->material_count;
+		}
+
+		if(obj_pack_mesh(mesh_out, vertices, indices, index_count, flags))
+		{
+			for(i=0, k=0; i<mesh_count; i++)
+			{
+				for(c=0; c<meshes[i].material_count; c++)
+					mesh_out->materials[k++] = meshes[i].materials[c];
+			}
+		}
+	}
+
+	free(indices);
+	free(vertices);
+	return mesh_out->block != NULL;
+}
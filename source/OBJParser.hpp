@@ -23,12 +23,15 @@
 #define OBJ_PARSER_H
 
 #include "List.hpp"
+#include "Mesh.hpp"
+#include <stddef.h>
+
 #include "StringExtra.hpp"
 
 #define OBJ_FILENAME_LENGTH 500
 #define MATERIAL_NAME_SIZE 255
 #define OBJ_LINE_SIZE 500
-#define MAX_VERTEX_COUNT 4 //can only handle quads or triangles
+#define MAX_VERTEX_COUNT 4 //obj_face keeps up to 4 corners, parse_obj_mesh triangulates any polygon
 
 typedef struct 
 {
@@ -110,15 +113,31 @@ typedef struct
 
 typedef struct
 {
-//	vector extreme_dimensions[2];
+	void *items;
+	int item_size;
+	int count;
+	int capacity;
+} obj_array;
+
+typedef struct
+{
+	int first_corner;
+	int corner_count;
+	int material_index;
+} obj_polygon;
+
+typedef struct
+{
 	char scene_filename[OBJ_FILENAME_LENGTH];
 	char material_filename[OBJ_FILENAME_LENGTH];
 	
-	list vertex_list;
-	list vertex_normal_list;
-	list vertex_texture_list;
+	obj_array positions;	//3 floats per vertex
+	obj_array normals;	//3 floats per normal
+	obj_array texcoords;	//2 floats per texture coordinate
+	
+	obj_array corners;	//3 ints (v, vt, vn) per polygon corner, zero based, -1 if absent
+	obj_array polygons;	//obj_polygon
 	
-	list face_list;
 	list sphere_list;
 	list plane_list;
 	
@@ -164,7 +183,48 @@ typedef struct
 	obj_camera *camera;
 } obj_scene_data;
 
+/* 
+ * Packed triangle mesh: welded interleaved vertices and one index stream of
+ * 16 or 32 bit indices, every array starts on a 16 byte boundary of one
+ * shared allocation
+ */
+typedef struct
+{
+	mesh_vertex *vertices;		//one per distinct (v, vt, vn, material) corner
+	void *indices;			//3 per triangle of every level of detail, index_size bytes each, relative to the chunk's base vertex
+	mesh_chunk *chunks;		//one unless the mesh was split for 16 bit indices
+
+	obj_material *materials;
+
+	int vertex_count;
+	int triangle_count;		//of the full level of detail
+	int index_count;		//of all levels of detail
+	int material_count;
+	int chunk_count;
+	int index_size;			//2 or 4
+	int flags;			//MESH_* load flags the mesh was built with
+	mesh_bounds bounds;		//of the vertex positions in model space
+
+	mesh_lod lods[MESH_MAX_LODS];	//lods[0] is the full mesh, coarser levels only exist for meshes in one chunk
+	int lod_count;
+
+	char material_filename[OBJ_FILENAME_LENGTH];
+
+	void *block;			//allocation holding all arrays
+	size_t block_size;
+	const char *mapping;		//mapped cache file the arrays point into instead, see MeshCache.hpp
+	size_t mapping_size;
+} obj_mesh;
+
 int parse_obj_scene(obj_scene_data *data_out, char *filename);
 void delete_obj_data(obj_scene_data *data_out);
 
+int parse_obj_mesh(obj_mesh *mesh_out, char *filename, int flags);
+void delete_obj_mesh(obj_mesh *mesh);
+
+int merge_obj_meshes(obj_mesh *mesh_out, const obj_mesh *meshes, const float *transforms, int mesh_count, int flags);
+
+const char* obj_map_file(const char *filename, size_t *size);
+void obj_unmap_file(const char *buffer, size_t size);
+
 #endif
@@ -0,0 +1,603 @@
+/******************************************************************
+*
+* Particles.c
+*
+* Description: Scalar and SIMD particle update kernels.
+*
+* Computer Graphics Proseminar SS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*******************************************************************/
+
+/* Standard includes */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PARTICLE_X86
+#include <immintrin.h>
+#endif
+
+#include "Particles.hpp"
+
+#define PARTICLE_AGING 0.0001f		//life lost per unit of delta
+#define PARTICLE_SOFTENING 10.0f	//keeps the pull finite near an attractor
+#define PARTICLE_RESPAWN_SCALE 0.01f	//respawned particles keep this much of position and velocity
+
+
+/******************************************************************
+*
+* particle_system_make
+*
+* Allocates the arrays of 'count' particles in one block; every
+* array starts aligned and is padded to PARTICLE_ALIGNMENT floats
+*
+*******************************************************************/
+
+void particle_system_make(particle_system *particles, int count)
+{
+	int padded = (count + PARTICLE_ALIGNMENT - 1) / PARTICLE_ALIGNMENT * PARTICLE_ALIGNMENT;
+	void *block = NULL;
+	float *arrays;
+
+	if(posix_memalign(&block, PARTICLE_ALIGNMENT * sizeof(float), sizeof(float) * padded * 7) != 0)
+		block = NULL;
+	arrays = (float*) block;
+	if(arrays)
+		memset(arrays, 0, sizeof(float) * padded * 7);
+
+	particles->x = arrays;
+	particles->y = arrays + padded;
+	particles->z = arrays + padded * 2;
+	particles->life = arrays + padded * 3;
+	particles->vx = arrays + padded * 4;
+	particles->vy = arrays + padded * 5;
+	particles->vz = arrays + padded * 6;
+	particles->count = arrays ? count : 0;
+}
+
+// copies the first 'count' particles of source, target must hold them
+void particle_system_copy(particle_system *target, const particle_system *source, int count)
+{
+	memcpy(target->x, source->x, sizeof(float) * count);
+	memcpy(target->y, source->y, sizeof(float) * count);
+	memcpy(target->z, source->z, sizeof(float) * count);
+	memcpy(target->life, source->life, sizeof(float) * count);
+	memcpy(target->vx, source->vx, sizeof(float) * count);
+	memcpy(target->vy, source->vy, sizeof(float) * count);
+	memcpy(target->vz, source->vz, sizeof(float) * count);
+}
+
+void particle_system_free(particle_system *particles)
+{
+	free(particles->x);
+	memset(particles, 0, sizeof(particle_system));
+}
+
+
+/******************************************************************
+*
+* particle_update_scalar
+*
+* Reference kernel, one particle at a time. The particle moves with
+* its velocity, then every attractor adds
+*   delta^2 * mass * normalize(d) / (|d|^2 + PARTICLE_SOFTENING)
+* for the distance d to it. The SIMD kernels do the same operations
+* in the same order
+*
+*******************************************************************/
+
+void particle_update_scalar(particle_system *particles, int first, int end,
+			    const float *attractors, int attractor_count, float delta, float *positions_out)
+{
+	float delta_squared = delta * delta;
+	int i, j;
+
+	for(i=first; i<end; i++)
+	{
+		float x = particles->x[i] + particles->vx[i] * delta;
+		float y = particles->y[i] + particles->vy[i] * delta;
+		float z = particles->z[i] + particles->vz[i] * delta;
+		float life = particles->life[i] - PARTICLE_AGING * delta;
+		float vx = particles->vx[i];
+		float vy = particles->vy[i];
+		float vz = particles->vz[i];
+
+		for(j=0; j<attractor_count; j++)
+		{
+			const float *attractor = attractors + j*4;
+			float dx = attractor[0] - x;
+			float dy = attractor[1] - y;
+			float dz = attractor[2] - z;
+			float distance_squared = dx*dx + dy*dy + dz*dz;
+			float pull = delta_squared * attractor[3] /
+				((distance_squared + PARTICLE_SOFTENING) * sqrtf(distance_squared));
+
+			vx += dx * pull;
+			vy += dy * pull;
+			vz += dz * pull;
+		}
+
+		// respawn near the origin
+		if(life <= 0.0f)
+		{
+			x *= -PARTICLE_RESPAWN_SCALE;
+			y *= -PARTICLE_RESPAWN_SCALE;
+			z *= -PARTICLE_RESPAWN_SCALE;
+			vx *= PARTICLE_RESPAWN_SCALE;
+			vy *= PARTICLE_RESPAWN_SCALE;
+			vz *= PARTICLE_RESPAWN_SCALE;
+			life += 1.0f;
+		}
+
+		particles->x[i] = x;
+		particles->y[i] = y;
+		particles->z[i] = z;
+		particles->life[i] = life;
+		particles->vx[i] = vx;
+		particles->vy[i] = vy;
+		particles->vz[i] = vz;
+
+		if(positions_out)
+		{
+			positions_out[i*4] = x;
+			positions_out[i*4 + 1] = y;
+			positions_out[i*4 + 2] = z;
+			positions_out[i*4 + 3] = life;
+		}
+	}
+}
+
+
+/******************************************************************
+*
+* particle_update_sse
+*
+* Four particles per step; the respawn branch becomes a masked
+* select and the positions are transposed to vec4s on the way out.
+* The remainder goes through the scalar kernel
+*
+*******************************************************************/
+
+#ifdef PARTICLE_X86
+__attribute__((target("sse")))
+#endif
+void particle_update_sse(particle_system *particles, int first, int end,
+			 const float *attractors, int attractor_count, float delta, float *positions_out)
+{
+	int i = first;
+
+#ifdef PARTICLE_X86
+	__m128 step = _mm_set1_ps(delta);
+	__m128 delta_squared = _mm_set1_ps(delta * delta);
+	__m128 aging = _mm_set1_ps(PARTICLE_AGING * delta);
+	__m128 softening = _mm_set1_ps(PARTICLE_SOFTENING);
+	__m128 respawn_position = _mm_set1_ps(-PARTICLE_RESPAWN_SCALE);
+	__m128 respawn_velocity = _mm_set1_ps(PARTICLE_RESPAWN_SCALE);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 zero = _mm_setzero_ps();
+	int j;
+
+	for(; i+4<=end; i+=4)
+	{
+		__m128 vx = _mm_loadu_ps(particles->vx + i);
+		__m128 vy = _mm_loadu_ps(particles->vy + i);
+		__m128 vz = _mm_loadu_ps(particles->vz + i);
+		__m128 x = _mm_add_ps(_mm_loadu_ps(particles->x + i), _mm_mul_ps(vx, step));
+		__m128 y = _mm_add_ps(_mm_loadu_ps(particles->y + i), _mm_mul_ps(vy, step));
+		__m128 z = _mm_add_ps(_mm_loadu_ps(particles->z + i), _mm_mul_ps(vz, step));
+		__m128 life = _mm_sub_ps(_mm_loadu_ps(particles->life + i), aging);
+		__m128 dead;
+
+		for(j=0; j<attractor_count; j++)
+		{
+			const float *attractor = attractors + j*4;
+			__m128 dx = _mm_sub_ps(_mm_set1_ps(attractor[0]), x);
+			__m128 dy = _mm_sub_ps(_mm_set1_ps(attractor[1]), y);
+			__m128 dz = _mm_sub_ps(_mm_set1_ps(attractor[2]), z);
+			__m128 distance_squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			__m128 pull = _mm_div_ps(_mm_mul_ps(delta_squared, _mm_set1_ps(attractor[3])),
+				_mm_mul_ps(_mm_add_ps(distance_squared, softening), _mm_sqrt_ps(distance_squared)));
+
+			vx = _mm_add_ps(vx, _mm_mul_ps(dx, pull));
+			vy = _mm_add_ps(vy, _mm_mul_ps(dy, pull));
+			vz = _mm_add_ps(vz, _mm_mul_ps(dz, pull));
+		}
+
+		// respawn: select the scaled values where life <= 0
+		dead = _mm_cmple_ps(life, zero);
+		x = _mm_or_ps(_mm_and_ps(dead, _mm_mul_ps(x, respawn_position)), _mm_andnot_ps(dead, x));
+		y = _mm_or_ps(_mm_and_ps(dead, _mm_mul_ps(y, respawn_position)), _mm_andnot_ps(dead, y));
+		z = _mm_or_ps(_mm_and_ps(dead, _mm_mul_ps(z, respawn_position)), _mm_andnot_ps(dead, z));
+		vx = _mm_or_ps(_mm_and_ps(dead, _mm_mul_ps(vx, respawn_velocity)), _mm_andnot_ps(dead, vx));
+		vy = _mm_or_ps(_mm_and_ps(dead, _mm_mul_ps(vy, respawn_velocity)), _mm_andnot_ps(dead, vy));
+		vz = _mm_or_ps(_mm_and_ps(dead, _mm_mul_ps(vz, respawn_velocity)), _mm_andnot_ps(dead, vz));
+		life = _mm_add_ps(life, _mm_and_ps(dead, one));
+
+		_mm_storeu_ps(particles->x + i, x);
+		_mm_storeu_ps(particles->y + i, y);
+		_mm_storeu_ps(particles->z + i, z);
+		_mm_storeu_ps(particles->life + i, life);
+		_mm_storeu_ps(particles->vx + i, vx);
+		_mm_storeu_ps(particles->vy + i, vy);
+		_mm_storeu_ps(particles->vz + i, vz);
+
+		if(positions_out)
+		{
+			_MM_TRANSPOSE4_PS(x, y, z, life);
+			_mm_storeu_ps(positions_out + i*4, x);
+			_mm_storeu_ps(positions_out + i*4 + 4, y);
+			_mm_storeu_ps(positions_out + i*4 + 8, z);
+			_mm_storeu_ps(positions_out + i*4 + 12, life);
+		}
+	}
+#endif
+
+	particle_update_scalar(particles, i, end, attractors, attractor_count, delta, positions_out);
+}
+
+
+/******************************************************************
+*
+* particle_update_avx
+*
+* Eight particles per step, otherwise like particle_update_sse; the
+* output transpose works on the two 4 particle halves
+*
+*******************************************************************/
+
+#ifdef PARTICLE_X86
+__attribute__((target("avx")))
+#endif
+void particle_update_avx(particle_system *particles, int first, int end,
+			 const float *attractors, int attractor_count, float delta, float *positions_out)
+{
+	int i = first;
+
+#ifdef PARTICLE_X86
+	__m256 step = _mm256_set1_ps(delta);
+	__m256 delta_squared = _mm256_set1_ps(delta * delta);
+	__m256 aging = _mm256_set1_ps(PARTICLE_AGING * delta);
+	__m256 softening = _mm256_set1_ps(PARTICLE_SOFTENING);
+	__m256 respawn_position = _mm256_set1_ps(-PARTICLE_RESPAWN_SCALE);
+	__m256 respawn_velocity = _mm256_set1_ps(PARTICLE_RESPAWN_SCALE);
+	__m256 one = _mm256_set1_ps(1.0f);
+	__m256 zero = _mm256_setzero_ps();
+	int j, half;
+
+	for(; i+8<=end; i+=8)
+	{
+		__m256 vx = _mm256_loadu_ps(particles->vx + i);
+		__m256 vy = _mm256_loadu_ps(particles->vy + i);
+		__m256 vz = _mm256_loadu_ps(particles->vz + i);
+		__m256 x = _mm256_add_ps(_mm256_loadu_ps(particles->x + i), _mm256_mul_ps(vx, step));
+		__m256 y = _mm256_add_ps(_mm256_loadu_ps(particles->y + i), _mm256_mul_ps(vy, step));
+		__m256 z = _mm256_add_ps(_mm256_loadu_ps(particles->z + i), _mm256_mul_ps(vz, step));
+		__m256 life = _mm256_sub_ps(_mm256_loadu_ps(particles->life + i), aging);
+		__m256 dead;
+
+		for(j=0; j<attractor_count; j++)
+		{
+			const float *attractor = attractors + j*4;
+			__m256 dx = _mm256_sub_ps(_mm256_set1_ps(attractor[0]), x);
+			__m256 dy = _mm256_sub_ps(_mm256_set1_ps(attractor[1]), y);
+			__m256 dz = _mm256_sub_ps(_mm256_set1_ps(attractor[2]), z);
+			__m256 distance_squared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+			__m256 pull = _mm256_div_ps(_mm256_mul_ps(delta_squared, _mm256_set1_ps(attractor[3])),
+				_mm256_mul_ps(_mm256_add_ps(distance_squared, softening), _mm256_sqrt_ps(distance_squared)));
+
+			vx = _mm256_add_ps(vx, _mm256_mul_ps(dx, pull));
+			vy = _mm256_add_ps(vy, _mm256_mul_ps(dy, pull));
+			vz = _mm256_add_ps(vz, _mm256_mul_ps(dz, pull));
+		}
+
+		dead = _mm256_cmp_ps(life, zero, _CMP_LE_OQ);
+		x = _mm256_blendv_ps(x, _mm256_mul_ps(x, respawn_position), dead);
+		y = _mm256_blendv_ps(y, _mm256_mul_ps(y, respawn_position), dead);
+		z = _mm256_blendv_ps(z, _mm256_mul_ps(z, respawn_position), dead);
+		vx = _mm256_blendv_ps(vx, _mm256_mul_ps(vx, respawn_velocity), dead);
+		vy = _mm256_blendv_ps(vy, _mm256_mul_ps(vy, respawn_velocity), dead);
+		vz = _mm256_blendv_ps(vz, _mm256_mul_ps(vz, respawn_velocity), dead);
+		life = _mm256_add_ps(life, _mm256_and_ps(dead, one));
+
+		_mm256_storeu_ps(particles->x + i, x);
+		_mm256_storeu_ps(particles->y + i, y);
+		_mm256_storeu_ps(particles->z + i, z);
+		_mm256_storeu_ps(particles->life + i, life);
+		_mm256_storeu_ps(particles->vx + i, vx);
+		_mm256_storeu_ps(particles->vy + i, vy);
+		_mm256_storeu_ps(particles->vz + i, vz);
+
+		if(positions_out)
+		{
+			for(half=0; half<2; half++)
+			{
+				float *out = positions_out + (i + half*4)*4;
+				__m128 px = half ? _mm256_extractf128_ps(x, 1) : _mm256_castps256_ps128(x);
+				__m128 py = half ? _mm256_extractf128_ps(y, 1) : _mm256_castps256_ps128(y);
+				__m128 pz = half ? _mm256_extractf128_ps(z, 1) : _mm256_castps256_ps128(z);
+				__m128 pw = half ? _mm256_extractf128_ps(life, 1) : _mm256_castps256_ps128(life);
+
+				_MM_TRANSPOSE4_PS(px, py, pz, pw);
+				_mm_storeu_ps(out, px);
+				_mm_storeu_ps(out + 4, py);
+				_mm_storeu_ps(out + 8, pz);
+				_mm_storeu_ps(out + 12, pw);
+			}
+		}
+	}
+#endif
+
+	particle_update_scalar(particles, i, end, attractors, attractor_count, delta, positions_out);
+}
+
+
+/******************************************************************
+*
+* particle_grid_make
+*
+* Allocates a grid for 'count' particles with twice as many hash
+* buckets, rounded up to a power of two
+*
+*******************************************************************/
+
+void particle_grid_make(particle_grid *grid, int count, float cell_size)
+{
+	int table_size = 1;
+
+	while(table_size < count * 2)
+		table_size *= 2;
+
+	grid->cell_size = cell_size;
+	grid->table_size = table_size;
+	grid->cell_start = (int*) malloc(sizeof(int) * (table_size + 1));
+	grid->cell_cursor = (int*) malloc(sizeof(int) * table_size);
+	grid->sorted = (int*) malloc(sizeof(int) * (count > 0 ? count : 1));
+	grid->particle_cell = (int*) malloc(sizeof(int) * (count > 0 ? count : 1));
+	grid->sorted_key = (int*) malloc(sizeof(int) * (count > 0 ? count : 1));
+	grid->sorted_x = (float*) malloc(sizeof(float) * (count > 0 ? count : 1));
+	grid->sorted_y = (float*) malloc(sizeof(float) * (count > 0 ? count : 1));
+	grid->sorted_z = (float*) malloc(sizeof(float) * (count > 0 ? count : 1));
+	grid->count = count;
+}
+
+void particle_grid_free(particle_grid *grid)
+{
+	free(grid->cell_start);
+	free(grid->cell_cursor);
+	free(grid->sorted);
+	free(grid->particle_cell);
+	free(grid->sorted_key);
+	free(grid->sorted_x);
+	free(grid->sorted_y);
+	free(grid->sorted_z);
+	memset(grid, 0, sizeof(particle_grid));
+}
+
+// hash bucket of grid cell x, y, z; linear in x, so the cells of a row are consecutive buckets
+int particle_grid_hash(const particle_grid *grid, int x, int y, int z)
+{
+	unsigned int hash = (unsigned int)x + (unsigned int)y * 19349663u + (unsigned int)z * 83492791u;
+	return (int)(hash & (unsigned int)(grid->table_size - 1));
+}
+
+// cell x, y, z packed into 10 bits each; cells 1024 apart never meet in a 3x3x3 neighborhood
+int particle_grid_key(int x, int y, int z)
+{
+	return ((x & 1023) << 20) | ((y & 1023) << 10) | (z & 1023);
+}
+
+
+/******************************************************************
+*
+* particle_grid_build
+*
+* Sorts the particles into the hash buckets of their cells with a
+* counting sort: count per bucket, prefix sum to bucket starts, then
+* scatter the particle indices along with their cells and positions,
+* so neighbor searches read contiguous memory
+*
+*******************************************************************/
+
+void particle_grid_build(particle_grid *grid, const particle_system *particles)
+{
+	float scale = 1.0f / grid->cell_size;
+	int count = particles->count < grid->count ? particles->count : grid->count;
+	int i, bucket, offset = 0;
+
+	memset(grid->cell_start, 0, sizeof(int) * (grid->table_size + 1));
+
+	for(i=0; i<count; i++)
+	{
+		bucket = particle_grid_hash(grid, (int)floorf(particles->x[i] * scale),
+			(int)floorf(particles->y[i] * scale), (int)floorf(particles->z[i] * scale));
+		grid->particle_cell[i] = bucket;
+		grid->cell_start[bucket]++;
+	}
+
+	for(bucket=0; bucket<grid->table_size; bucket++)
+	{
+		int bucket_count = grid->cell_start[bucket];
+		grid->cell_start[bucket] = offset;
+		grid->cell_cursor[bucket] = offset;
+		offset += bucket_count;
+	}
+	grid->cell_start[grid->table_size] = offset;
+
+	for(i=0; i<count; i++)
+	{
+		int n = grid->cell_cursor[grid->particle_cell[i]]++;
+
+		grid->sorted[n] = i;
+		grid->sorted_key[n] = particle_grid_key((int)floorf(particles->x[i] * scale),
+			(int)floorf(particles->y[i] * scale), (int)floorf(particles->z[i] * scale));
+		grid->sorted_x[n] = particles->x[i];
+		grid->sorted_y[n] = particles->y[i];
+		grid->sorted_z[n] = particles->z[i];
+	}
+}
+
+
+/******************************************************************
+*
+* particle_repel
+*
+* Pushes the particles first to end-1 away from all neighbors closer
+* than 'radius' with the pressure-like falloff (1 - r/radius)^2. Only
+* the velocities of those particles change and positions are only
+* read, so disjoint ranges can run in parallel. The 3 cells of each
+* of the 9 neighboring rows are consecutive buckets and thus one
+* range of sorted particles. Buckets hold all cells hashing to them,
+* so only particles whose cell lies in the searched row count; that
+* also keeps rows sharing buckets from counting a particle twice
+*
+*******************************************************************/
+
+void particle_repel(particle_system *particles, const particle_grid *grid, int first, int end,
+		    float radius, float strength, float delta)
+{
+	float scale = 1.0f / grid->cell_size;
+	float radius_squared = radius * radius;
+	float impulse = strength * delta;
+	int i, n;
+
+	for(i=first; i<end; i++)
+	{
+		float x = particles->x[i], y = particles->y[i], z = particles->z[i];
+		int cell_x = (int)floorf(x * scale);
+		int cell_y = (int)floorf(y * scale);
+		int cell_z = (int)floorf(z * scale);
+		float force_x = 0.0f, force_y = 0.0f, force_z = 0.0f;
+		int dy, dz, part;
+
+		for(dz=-1; dz<=1; dz++)
+		for(dy=-1; dy<=1; dy++)
+		for(part=0; part<2; part++)
+		{
+			int row_key = particle_grid_key(0, cell_y + dy, cell_z + dz);
+			int bucket = particle_grid_hash(grid, cell_x - 1, cell_y + dy, cell_z + dz);
+			// the part of the row's buckets before and after the end of the table
+			int from = part ? 0 : bucket;
+			int to = part ? bucket + 3 - grid->table_size : bucket + 3;
+
+			if(to > grid->table_size)
+				to = grid->table_size;
+			if(to <= from)
+				continue;
+
+			for(n=grid->cell_start[from]; n<grid->cell_start[to]; n++)
+			{
+				int key = grid->sorted_key[n];
+				float offset_x = x - grid->sorted_x[n];
+				float offset_y = y - grid->sorted_y[n];
+				float offset_z = z - grid->sorted_z[n];
+				float distance_squared = offset_x*offset_x + offset_y*offset_y + offset_z*offset_z;
+				float distance, weight;
+
+				if((key & 0xfffff) != row_key || (((key >> 20) - cell_x + 1) & 1023) > 2 ||
+				   distance_squared >= radius_squared || distance_squared == 0.0f)
+					continue;
+
+				distance = sqrtf(distance_squared);
+				weight = 1.0f - distance / radius;
+				weight = weight * weight / distance;
+				force_x += offset_x * weight;
+				force_y += offset_y * weight;
+				force_z += offset_z * weight;
+			}
+		}
+
+		particles->vx[i] += force_x * impulse;
+		particles->vy[i] += force_y * impulse;
+		particles->vz[i] += force_z * impulse;
+	}
+}
+
+
+/******************************************************************
+*
+* particle_select_kernel
+*
+* Returns the widest kernel the running CPU supports and its name
+*
+*******************************************************************/
+
+particle_kernel particle_select_kernel(const char **name_out)
+{
+	const char *name = "scalar";
+	particle_kernel kernel = particle_update_scalar;
+
+#ifdef PARTICLE_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx"))
+	{
+		name = "avx";
+		kernel = particle_update_avx;
+	}
+	else if(__builtin_cpu_supports("sse"))
+	{
+		name = "sse";
+		kernel = particle_update_sse;
+	}
+#endif
+
+	if(name_out)
+		*name_out = name;
+	return kernel;
+}
+
+
+/******************************************************************
+*
+* particle_kernel_deviation
+*
+* Validates a kernel against the scalar reference: runs both for
+* 'steps' updates on copies of the first 'count' particles of
+* 'state' and returns the largest difference of any position,
+* velocity or life
+*
+*******************************************************************/
+
+float particle_kernel_deviation(particle_kernel kernel, const particle_system *state, int count,
+				const float *attractors, int attractor_count, float delta, int steps)
+{
+	particle_system reference, tested;
+	float deviation = 0.0f;
+	int i, step;
+
+	particle_system_make(&reference, count);
+	particle_system_make(&tested, count);
+	particle_system_copy(&reference, state, count);
+	particle_system_copy(&tested, state, count);
+
+	for(step=0; step<steps; step++)
+	{
+		particle_update_scalar(&reference, 0, count, attractors, attractor_count, delta, NULL);
+		kernel(&tested, 0, count, attractors, attractor_count, delta, NULL);
+	}
+
+	for(i=0; i<count; i++)
+	{
+		float differences[7] = {
+			reference.x[i] - tested.x[i], reference.y[i] - tested.y[i], reference.z[i] - tested.z[i],
+			reference.life[i] - tested.life[i],
+			reference.vx[i] - tested.vx[i], reference.vy[i] - tested.vy[i], reference.vz[i] - tested.vz[i]
+		};
+		int k;
+
+		for(k=0; k<7; k++)
+		{
+			if(fabsf(differences[k]) > deviation)
+				deviation = fabsf(differences[k]);
+		}
+	}
+
+	particle_system_free(&reference);
+	particle_system_free(&tested);
+	return deviation;
+}
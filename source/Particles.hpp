@@ -0,0 +1,80 @@
+/******************************************************************
+*
+* Particles.h
+*
+* Description: CPU particle simulation on structure of arrays
+*              state. The update kernel moves the particles, pulls
+*              them towards the attractors, respawns dead ones and
+*              writes the positions as interleaved x, y, z, life
+*              vec4s for a vertex buffer. Besides the scalar
+*              reference there are SSE and AVX versions working on
+*              4 and 8 particles at once; particle_select_kernel
+*              picks the widest one the CPU supports at runtime.
+*              For interactions between particles, a uniform grid
+*              is hashed into a table and rebuilt every step with
+*              a counting sort; neighbors are then found in the 27
+*              surrounding cells in O(n) total.
+*
+* Computer Graphics Proseminar SS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*******************************************************************/
+
+#ifndef __PARTICLES_H__
+#define __PARTICLES_H__
+
+/* Arrays are aligned to and padded to this many floats */
+#define PARTICLE_ALIGNMENT 8
+
+typedef struct
+{
+	float *x, *y, *z;
+	float *life;		//particle respawns when it falls to 0
+	float *vx, *vy, *vz;
+	int count;
+} particle_system;
+
+/* Updates the particles first to end-1; attractors holds x, y, z, mass
+   per attractor, positions_out (may be NULL) gets 4 floats per particle */
+typedef void (*particle_kernel)(particle_system *particles, int first, int end,
+				const float *attractors, int attractor_count, float delta, float *positions_out);
+
+void particle_system_make(particle_system *particles, int count);
+void particle_system_copy(particle_system *target, const particle_system *source, int count);
+void particle_system_free(particle_system *particles);
+
+void particle_update_scalar(particle_system *particles, int first, int end,
+			    const float *attractors, int attractor_count, float delta, float *positions_out);
+void particle_update_sse(particle_system *particles, int first, int end,
+			 const float *attractors, int attractor_count, float delta, float *positions_out);
+void particle_update_avx(particle_system *particles, int first, int end,
+			 const float *attractors, int attractor_count, float delta, float *positions_out);
+
+typedef struct
+{
+	float cell_size;	//at least the interaction radius
+	int table_size;		//hash buckets, a power of two
+	int *cell_start;	//table_size+1 offsets into sorted
+	int *cell_cursor;
+	int *sorted;		//particle indices ordered by bucket
+	int *particle_cell;	//bucket of every particle
+	int *sorted_key;	//packed cell of every sorted particle, tells cells sharing a bucket apart
+	float *sorted_x, *sorted_y, *sorted_z;	//positions in sorted order
+	int count;
+} particle_grid;
+
+void particle_grid_make(particle_grid *grid, int count, float cell_size);
+void particle_grid_build(particle_grid *grid, const particle_system *particles);
+void particle_grid_free(particle_grid *grid);
+void particle_repel(particle_system *particles, const particle_grid *grid, int first, int end,
+		    float radius, float strength, float delta);
+
+particle_kernel particle_select_kernel(const char **name_out);
+float particle_kernel_deviation(particle_kernel kernel, const particle_system *state, int count,
+				const float *attractors, int attractor_count, float delta, int steps);
+
+#endif // __PARTICLES_H__
@@ -0,0 +1,232 @@
+/******************************************************************
+*
+* Profiler.c
+*
+* Description: CPU and GPU timing of the passes of a frame.
+*
+* Computer Graphics Proseminar SS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*******************************************************************/
+
+/* Standard includes */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* OpenGL includes */
+#include <GL/glew.h>
+
+#include "Profiler.hpp"
+
+
+// monotonic time in milliseconds
+double profiler_time()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+void profiler_record(profiler_section *section, float milliseconds)
+{
+	section->samples[section->next_sample] = milliseconds;
+	section->next_sample = (section->next_sample + 1) % PROFILER_HISTORY;
+	if(section->sample_count < PROFILER_HISTORY)
+		section->sample_count++;
+}
+
+// reads back the query in 'slot', waiting for it only if 'wait' is set
+void profiler_collect_query(profiler_section *section, int slot, int wait)
+{
+	GLuint64 nanoseconds;
+	GLint available = 1;
+
+	if(!section->query_pending[slot])
+		return;
+
+	if(!wait)
+		glGetQueryObjectiv(section->queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+	if(!available)
+		return;
+
+	glGetQueryObjectui64v(section->queries[slot], GL_QUERY_RESULT, &nanoseconds);
+	profiler_record(section, nanoseconds / 1000000.0f);
+	section->query_pending[slot] = 0;
+}
+
+
+void profiler_make(profiler *prof)
+{
+	memset(prof, 0, sizeof(profiler));
+	profiler_add_section(prof, "frame", PROFILER_CPU);
+	prof->frame_start = profiler_time();
+}
+
+
+/******************************************************************
+*
+* profiler_add_section
+*
+* Adds a named section and returns its index; GPU sections create
+* their queries, so they need a current OpenGL context
+*
+*******************************************************************/
+
+int profiler_add_section(profiler *prof, const char *name, int gpu)
+{
+	profiler_section *section;
+
+	if(prof->section_count == PROFILER_MAX_SECTIONS)
+		return -1;
+
+	section = prof->sections + prof->section_count;
+	memset(section, 0, sizeof(profiler_section));
+	section->name = name;
+	section->gpu = gpu;
+	if(gpu)
+		glGenQueries(PROFILER_QUERY_FRAMES, section->queries);
+
+	return prof->section_count++;
+}
+
+
+/******************************************************************
+*
+* profiler_begin_frame
+*
+* Records the frame time and collects the GPU results of earlier
+* frames that are ready by now
+*
+*******************************************************************/
+
+void profiler_begin_frame(profiler *prof)
+{
+	double now = profiler_time();
+	int i, slot;
+
+	profiler_record(prof->sections + PROFILER_FRAME, (float)(now - prof->frame_start));
+	prof->frame_start = now;
+	prof->frame++;
+
+	for(i=0; i<prof->section_count; i++)
+	{
+		if(!prof->sections[i].gpu)
+			continue;
+		for(slot=0; slot<PROFILER_QUERY_FRAMES; slot++)
+			profiler_collect_query(prof->sections + i, slot, 0);
+	}
+}
+
+void profiler_begin(profiler *prof, int section_index)
+{
+	profiler_section *section;
+	int slot = prof->frame % PROFILER_QUERY_FRAMES;
+
+	if(section_index < 0)
+		return;
+	section = prof->sections + section_index;
+
+	if(section->gpu)
+	{
+		// the GPU is more than a ring behind; only then wait for it
+		profiler_collect_query(section, slot, 1);
+		glBeginQuery(GL_TIME_ELAPSED, section->queries[slot]);
+	}
+	else
+		section->cpu_start = profiler_time();
+}
+
+void profiler_end(profiler *prof, int section_index)
+{
+	profiler_section *section;
+
+	if(section_index < 0)
+		return;
+	section = prof->sections + section_index;
+
+	if(section->gpu)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		section->query_pending[prof->frame % PROFILER_QUERY_FRAMES] = 1;
+	}
+	else
+		profiler_record(section, (float)(profiler_time() - section->cpu_start));
+}
+
+
+int profiler_compare_samples(const void *a, const void *b)
+{
+	float difference = *(const float*)a - *(const float*)b;
+	return (difference > 0.0f) - (difference < 0.0f);
+}
+
+/******************************************************************
+*
+* profiler_stats
+*
+* Minimum, average and 99th percentile of the samples a section
+* holds, in milliseconds; all zero without samples
+*
+*******************************************************************/
+
+void profiler_stats(profiler *prof, int section_index, float *min, float *avg, float *p99)
+{
+	profiler_section *section = prof->sections + section_index;
+	float sorted[PROFILER_HISTORY];
+	float sum = 0.0f;
+	int count = section->sample_count;
+	int i;
+
+	*min = *avg = *p99 = 0.0f;
+	if(count == 0)
+		return;
+
+	memcpy(sorted, section->samples, sizeof(float) * count);
+	qsort(sorted, count, sizeof(float), profiler_compare_samples);
+	for(i=0; i<count; i++)
+		sum += sorted[i];
+
+	*min = sorted[0];
+	*avg = sum / count;
+	*p99 = sorted[(count * 99 + 99) / 100 - 1];
+}
+
+
+/******************************************************************
+*
+* profiler_report
+*
+* Writes one line of statistics per section
+*
+*******************************************************************/
+
+void profiler_report(profiler *prof, FILE *file)
+{
+	float min, avg, p99;
+	int i;
+
+	fprintf(file, "%-16s %4s %8s %8s %8s\n", "section", "", "min ms", "avg ms", "p99 ms");
+	for(i=0; i<prof->section_count; i++)
+	{
+		profiler_stats(prof, i, &min, &avg, &p99);
+		fprintf(file, "%-16s %4s %8.3f %8.3f %8.3f\n", prof->sections[i].name,
+			prof->sections[i].gpu ? "gpu" : "cpu", min, avg, p99);
+	}
+}
+
+void profiler_free(profiler *prof)
+{
+	int i;
+
+	for(i=0; i<prof->section_count; i++)
+	{
+		if(prof->sections[i].gpu)
+			glDeleteQueries(PROFILER_QUERY_FRAMES, prof->sections[i].queries);
+	}
+	prof->section_count = 0;
+}
@@ -0,0 +1,72 @@
+/******************************************************************
+*
+* Profiler.h
+*
+* Description: Frame profiler with named sections timed either on
+*              the CPU or on the GPU with GL_TIME_ELAPSED queries.
+*              Every section keeps the samples of the last frames
+*              for rolling min/avg/p99 statistics. GPU queries are
+*              kept in a small ring per section and read back a few
+*              frames later, so reading them does not stall.
+*              GL_TIME_ELAPSED queries cannot nest, GPU sections
+*              must not overlap.
+*
+* Computer Graphics Proseminar SS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*******************************************************************/
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <stdio.h>
+
+#define PROFILER_MAX_SECTIONS 16
+#define PROFILER_HISTORY 256		//samples kept per section
+#define PROFILER_QUERY_FRAMES 4		//frames a GPU result may lag behind
+
+#define PROFILER_CPU 0
+#define PROFILER_GPU 1
+
+/* section 0 always holds the time between two profiler_begin_frame calls */
+#define PROFILER_FRAME 0
+
+typedef struct
+{
+	const char *name;
+	int gpu;
+
+	float samples[PROFILER_HISTORY];	//milliseconds, ring buffer
+	int sample_count;
+	int next_sample;
+
+	double cpu_start;
+	unsigned int queries[PROFILER_QUERY_FRAMES];
+	char query_pending[PROFILER_QUERY_FRAMES];
+} profiler_section;
+
+typedef struct
+{
+	profiler_section sections[PROFILER_MAX_SECTIONS];
+	int section_count;
+
+	int frame;
+	double frame_start;
+} profiler;
+
+double profiler_time();
+
+void profiler_make(profiler *prof);
+int profiler_add_section(profiler *prof, const char *name, int gpu);
+void profiler_begin_frame(profiler *prof);
+void profiler_begin(profiler *prof, int section);
+void profiler_end(profiler *prof, int section);
+void profiler_stats(profiler *prof, int section, float *min, float *avg, float *p99);
+void profiler_report(profiler *prof, FILE *file);
+void profiler_free(profiler *prof);
+
+#endif // __PROFILER_H__
@@ -0,0 +1,183 @@
+/******************************************************************
+*
+* RenderQueue.c
+*
+* Description: Sorted queue of the draw calls of a frame.
+*
+* Computer Graphics Proseminar SS 2015
+* 
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*******************************************************************/
+
+/* Standard includes */
+#include <stdlib.h>
+#include <string.h>
+
+#include "RenderQueue.hpp"
+
+
+/******************************************************************
+*
+* render_key
+*
+* Packs the state of a draw into a sort key; the fields are masked
+* to their widths, depth is clamped to [0, 1] so nearer items sort
+* first within the same state
+*
+*******************************************************************/
+
+unsigned long long render_key(unsigned int shader, unsigned int material, unsigned int mesh, float depth)
+{
+	unsigned long long key;
+	unsigned int depth_bits;
+
+	if(!(depth > 0.0f))
+		depth = 0.0f;
+	if(depth > 1.0f)
+		depth = 1.0f;
+	depth_bits = (unsigned int)(depth * ((1u << RENDER_KEY_DEPTH_BITS) - 1));
+
+	key = shader & ((1u << RENDER_KEY_SHADER_BITS) - 1);
+	key = (key << RENDER_KEY_MATERIAL_BITS) | (material & ((1u << RENDER_KEY_MATERIAL_BITS) - 1));
+	key = (key << RENDER_KEY_MESH_BITS) | (mesh & ((1u << RENDER_KEY_MESH_BITS) - 1));
+	key = (key << RENDER_KEY_DEPTH_BITS) | depth_bits;
+	return key;
+}
+
+
+/******************************************************************
+*
+* render_queue_reserve
+*
+* Grows the item arrays to hold at least 'capacity' items
+*
+*******************************************************************/
+
+void render_queue_reserve(render_queue *queue, int capacity)
+{
+	if(capacity <= queue->capacity)
+		return;
+
+	queue->items = (render_item*) realloc(queue->items, sizeof(render_item) * capacity);
+	queue->scratch = (render_item*) realloc(queue->scratch, sizeof(render_item) * capacity);
+	queue->capacity = capacity;
+}
+
+
+void render_queue_make(render_queue *queue, int capacity)
+{
+	queue->items = NULL;
+	queue->scratch = NULL;
+	queue->sorted = NULL;
+	queue->item_count = 0;
+	queue->capacity = 0;
+	render_queue_reserve(queue, capacity > 0 ? capacity : 64);
+}
+
+void render_queue_clear(render_queue *queue)
+{
+	queue->item_count = 0;
+	queue->sorted = NULL;
+}
+
+// returns the next free item, the caller fills in all fields
+render_item* render_queue_add(render_queue *queue)
+{
+	if(queue->item_count == queue->capacity)
+		render_queue_reserve(queue, queue->capacity * 2);
+
+	queue->sorted = NULL;
+	return queue->items + queue->item_count++;
+}
+
+
+/******************************************************************
+*
+* render_queue_sort
+*
+* Stable LSD radix sort of the items by key, one byte per pass;
+* passes where all keys share the byte are skipped. The result is
+* in queue->sorted, which points to items or scratch
+*
+*******************************************************************/
+
+void render_queue_sort(render_queue *queue)
+{
+	render_item *source = queue->items;
+	render_item *target = queue->scratch;
+	int counts[256];
+	int shift, i;
+
+	for(shift=0; shift<64; shift+=8)
+	{
+		int offset = 0;
+
+		memset(counts, 0, sizeof(counts));
+		for(i=0; i<queue->item_count; i++)
+			counts[(source[i].key >> shift) & 0xff]++;
+
+		if(queue->item_count == 0 || counts[(source[0].key >> shift) & 0xff] == queue->item_count)
+			continue;
+
+		for(i=0; i<256; i++)
+		{
+			int count = counts[i];
+			counts[i] = offset;
+			offset += count;
+		}
+
+		for(i=0; i<queue->item_count; i++)
+			target[counts[(source[i].key >> shift) & 0xff]++] = source[i];
+
+		target = source;
+		source = source == queue->items ? queue->scratch : queue->items;
+	}
+
+	queue->sorted = source;
+}
+
+
+/******************************************************************
+*
+* render_queue_batch_end
+*
+* Returns the end of the run of sorted items starting at 'first'
+* that share all state, i.e. could be submitted with one multi draw
+* call; instanced items always form runs of one
+*
+*******************************************************************/
+
+int render_queue_batch_end(render_queue *queue, int first)
+{
+	render_item *items = queue->sorted;
+	int end = first + 1;
+
+	if(items[first].instance_count > 0)
+		return end;
+
+	while(end < queue->item_count &&
+		items[end].instance_count == 0 &&
+		items[end].shader == items[first].shader &&
+		items[end].vertex_array == items[first].vertex_array &&
+		items[end].material_buffer == items[first].material_buffer &&
+		items[end].object == items[first].object &&
+		items[end].index_type == items[first].index_type)
+		end++;
+
+	return end;
+}
+
+void render_queue_free(render_queue *queue)
+{
+	free(queue->items);
+	free(queue->scratch);
+	queue->items = NULL;
+	queue->scratch = NULL;
+	queue->sorted = NULL;
+	queue->item_count = 0;
+	queue->capacity = 0;
+}
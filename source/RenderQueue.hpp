@@ -0,0 +1,67 @@
+/******************************************************************
+*
+* RenderQueue.h
+*
+* Description: Collects the draw calls of a frame as items with a
+*              64 bit sort key (shader, material, mesh, depth from
+*              high to low bits) and sorts them so that submitting
+*              them in order changes as little state as possible.
+*              The queue holds plain handles and does not call
+*              OpenGL itself.
+*
+* Computer Graphics Proseminar SS 2015
+* 
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*******************************************************************/
+
+#ifndef __RENDER_QUEUE_H__
+#define __RENDER_QUEUE_H__
+
+#include <stddef.h>
+
+/* Bits of the sort key fields */
+#define RENDER_KEY_SHADER_BITS 8
+#define RENDER_KEY_MATERIAL_BITS 16
+#define RENDER_KEY_MESH_BITS 16
+#define RENDER_KEY_DEPTH_BITS 24
+
+typedef struct
+{
+	unsigned long long key;
+
+	unsigned int shader;		//shader variant, e.g. instanced or not
+	unsigned int vertex_array;	//VAO with vertex layout and index buffer
+	unsigned int material_buffer;	//uniform buffer with the materials
+	int object;			//transform to use, -1 if the vertices or instances carry their own
+
+	unsigned int index_type;
+	int index_count;
+	size_t index_offset;		//in bytes
+	int base_vertex;
+	int instance_count;		//0 for a plain draw
+} render_item;
+
+typedef struct
+{
+	render_item *items;
+	int item_count;
+	int capacity;
+
+	render_item *sorted;		//items in key order after render_queue_sort
+	render_item *scratch;
+} render_queue;
+
+unsigned long long render_key(unsigned int shader, unsigned int material, unsigned int mesh, float depth);
+
+void render_queue_make(render_queue *queue, int capacity);
+void render_queue_clear(render_queue *queue);
+render_item* render_queue_add(render_queue *queue);
+void render_queue_sort(render_queue *queue);
+int render_queue_batch_end(render_queue *queue, int first);
+void render_queue_free(render_queue *queue);
+
+#endif // __RENDER_QUEUE_H__
@@ -0,0 +1,321 @@
+/******************************************************************
+*
+* ThreadPool.c
+*
+* Description: Persistent pool of worker threads executing queued
+*              tasks.
+*
+* Computer Graphics Proseminar SS 2015
+* 
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*******************************************************************/
+
+/* Standard includes */
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ThreadPool.hpp"
+
+
+/******************************************************************
+*
+* thread_pool_worker
+*
+* Main loop of every worker thread; takes tasks from the queue
+* until the pool is stopped
+*
+*******************************************************************/
+
+void* thread_pool_worker(void *argument)
+{
+	thread_pool *pool = (thread_pool*) argument;
+	thread_task task;
+
+	pthread_mutex_lock(&pool->lock);
+	for(;;)
+	{
+		while(pool->task_count == 0 && !pool->stop)
+			pthread_cond_wait(&pool->task_available, &pool->lock);
+
+		if(pool->task_count == 0)
+			break;
+
+		task = pool->tasks[pool->task_head];
+		pool->task_head = (pool->task_head + 1) % pool->task_capacity;
+		pool->task_count--;
+
+		pthread_mutex_unlock(&pool->lock);
+		task.func(task.argument);
+		pthread_mutex_lock(&pool->lock);
+
+		pool->pending--;
+		if(pool->pending == 0)
+			pthread_cond_broadcast(&pool->tasks_done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+
+/******************************************************************
+*
+* thread_pool_core_count
+*
+* Returns the number of online processors, at least 1
+*
+*******************************************************************/
+
+int thread_pool_core_count()
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return cores > 0 ? (int)cores : 1;
+}
+
+
+/******************************************************************
+*
+* thread_pool_make
+*
+* Starts 'thread_count' workers; 0 starts one per core
+*
+*******************************************************************/
+
+void thread_pool_make(thread_pool *pool, int thread_count)
+{
+	int i;
+
+	if(thread_count <= 0)
+		thread_count = thread_pool_core_count();
+
+	pool->thread_count = thread_count;
+	pool->task_capacity = 64;
+	pool->tasks = (thread_task*) malloc(sizeof(thread_task) * pool->task_capacity);
+	pool->task_head = 0;
+	pool->task_count = 0;
+	pool->pending = 0;
+	pool->stop = 0;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->task_available, NULL);
+	pthread_cond_init(&pool->tasks_done, NULL);
+
+	pool->threads = (pthread_t*) malloc(sizeof(pthread_t) * thread_count);
+	for(i=0; i<thread_count; i++)
+		pthread_create(&pool->threads[i], NULL, thread_pool_worker, pool);
+}
+
+
+/******************************************************************
+*
+* thread_pool_add_task
+*
+*******************************************************************/
+
+void thread_pool_add_task(thread_pool *pool, thread_task_func func, void *argument)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+
+	if(pool->task_count == pool->task_capacity)
+	{
+		thread_task *tasks = (thread_task*) malloc(sizeof(thread_task) * pool->task_capacity * 2);
+		for(i=0; i<pool->task_count; i++)
+			tasks[i] = pool->tasks[(pool->task_head + i) % pool->task_capacity];
+
+		free(pool->tasks);
+		pool->tasks = tasks;
+		pool->task_head = 0;
+		pool->task_capacity *= 2;
+	}
+
+	pool->tasks[(pool->task_head + pool->task_count) % pool->task_capacity].func = func;
+	pool->tasks[(pool->task_head + pool->task_count) % pool->task_capacity].argument = argument;
+	pool->task_count++;
+	pool->pending++;
+
+	pthread_cond_signal(&pool->task_available);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+
+/******************************************************************
+*
+* thread_pool_wait
+*
+*******************************************************************/
+
+void thread_pool_wait(thread_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	while(pool->pending > 0)
+		pthread_cond_wait(&pool->tasks_done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+
+/******************************************************************
+*
+* thread_pool_free
+*
+* Finishes the queued tasks and joins all workers
+*
+*******************************************************************/
+
+void thread_pool_free(thread_pool *pool)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->task_available);
+	pthread_mutex_unlock(&pool->lock);
+
+	for(i=0; i<pool->thread_count; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->task_available);
+	pthread_cond_destroy(&pool->tasks_done);
+
+	free(pool->threads);
+	free(pool->tasks);
+}
+
+
+/******************************************************************
+*
+* thread_range_run
+*
+* Works off the chunks of one slice, then steals chunks from the
+* other slices until all are empty
+*
+*******************************************************************/
+
+void thread_range_run(thread_range_job *job, int own_slice)
+{
+	int k;
+
+	for(k=0; k<job->slice_count; k++)
+	{
+		thread_range_slice *slice = job->slices + (own_slice + k) % job->slice_count;
+
+		for(;;)
+		{
+			int first = __atomic_fetch_add(&slice->next, job->grain, __ATOMIC_RELAXED);
+			int end = first + job->grain;
+
+			if(first >= slice->end)
+				break;
+			if(end > slice->end)
+				end = slice->end;
+
+			job->func(job->argument, first, end);
+		}
+	}
+}
+
+void thread_range_task(void *argument)
+{
+	thread_range_worker *worker = (thread_range_worker*) argument;
+	thread_range_job *job = worker->job;
+
+	thread_range_run(job, worker->slice);
+
+	// the last worker to leave wakes the waiting thread
+	pthread_mutex_lock(&job->lock);
+	job->running--;
+	if(job->running == 0)
+		pthread_cond_broadcast(&job->done);
+	pthread_mutex_unlock(&job->lock);
+}
+
+
+/******************************************************************
+*
+* thread_pool_parallel_for_begin
+*
+* Starts func(argument, first, end) over the indices 0 to count-1
+* in chunks of 'grain' and returns at once; slices start at
+* multiples of 'grain', so chunks only end off the grid at 'count'.
+* The job must stay alive until thread_pool_parallel_for_wait
+*
+*******************************************************************/
+
+void thread_pool_parallel_for_begin(thread_pool *pool, thread_range_job *job, int count, int grain,
+				    thread_range_func func, void *argument)
+{
+	int chunk_count, i;
+
+	if(grain < 1)
+		grain = 1;
+	chunk_count = (count + grain - 1) / grain;
+
+	job->func = func;
+	job->argument = argument;
+	job->count = count;
+	job->grain = grain;
+	pthread_mutex_init(&job->lock, NULL);
+	pthread_cond_init(&job->done, NULL);
+
+	// one slice per worker and the last one for the waiting thread
+	job->slice_count = pool->thread_count + 1;
+	if(job->slice_count > THREAD_POOL_MAX_SLICES)
+		job->slice_count = THREAD_POOL_MAX_SLICES;
+	if(job->slice_count > chunk_count)
+		job->slice_count = chunk_count > 0 ? chunk_count : 1;
+
+	for(i=0; i<job->slice_count; i++)
+	{
+		long long first_chunk = (long long)chunk_count * i / job->slice_count;
+		long long end_chunk = (long long)chunk_count * (i + 1) / job->slice_count;
+
+		job->slices[i].next = (int)(first_chunk * grain);
+		job->slices[i].end = end_chunk * grain < count ? (int)(end_chunk * grain) : count;
+	}
+
+	job->running = job->slice_count - 1;
+	for(i=0; i<job->slice_count - 1; i++)
+	{
+		job->workers[i].job = job;
+		job->workers[i].slice = i;
+		thread_pool_add_task(pool, thread_range_task, job->workers + i);
+	}
+}
+
+
+/******************************************************************
+*
+* thread_pool_parallel_for_wait
+*
+* Helps with the remaining chunks and returns once all indices of
+* the job are done; a worker only leaves when no chunk is left, so
+* that is once all workers have left
+*
+*******************************************************************/
+
+void thread_pool_parallel_for_wait(thread_range_job *job)
+{
+	thread_range_run(job, job->slice_count - 1);
+
+	pthread_mutex_lock(&job->lock);
+	while(job->running > 0)
+		pthread_cond_wait(&job->done, &job->lock);
+	pthread_mutex_unlock(&job->lock);
+
+	pthread_mutex_destroy(&job->lock);
+	pthread_cond_destroy(&job->done);
+}
+
+void thread_pool_parallel_for(thread_pool *pool, int count, int grain, thread_range_func func, void *argument)
+{
+	thread_range_job job;
+
+	thread_pool_parallel_for_begin(pool, &job, count, grain, func, argument);
+	thread_pool_parallel_for_wait(&job);
+}
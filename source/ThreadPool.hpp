@@ -0,0 +1,100 @@
+/******************************************************************
+*
+* ThreadPool.h
+*
+* Description: Persistent pool of worker threads executing queued
+*              tasks. Tasks are plain function pointers with one
+*              argument; thread_pool_wait blocks until all tasks
+*              added so far have finished.
+*              Parallel for loops split an index range into one
+*              slice per worker plus one for the caller. Everyone
+*              takes chunks of 'grain' indices from its own slice
+*              and then steals chunks from the others, so uneven
+*              chunks balance out. Waiting on the loop is the
+*              barrier after which all indices are done.
+*
+* Computer Graphics Proseminar SS 2015
+* 
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+* Andreas Moritz, Philipp Wirtenberger, Martin Agreiter
+*******************************************************************/
+
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <pthread.h>
+
+typedef void (*thread_task_func)(void *argument);
+typedef void (*thread_range_func)(void *argument, int first, int end);
+
+#define THREAD_POOL_MAX_SLICES 64
+
+typedef struct
+{
+	thread_task_func func;
+	void *argument;
+} thread_task;
+
+typedef struct
+{
+	pthread_t *threads;
+	int thread_count;
+
+	thread_task *tasks;	//ring buffer of queued tasks
+	int task_capacity;
+	int task_head;
+	int task_count;
+	int pending;		//queued and running tasks
+	char stop;
+
+	pthread_mutex_t lock;
+	pthread_cond_t task_available;
+	pthread_cond_t tasks_done;
+} thread_pool;
+
+typedef struct
+{
+	int next;		//next index to take, advanced atomically
+	int end;
+	char padding[56];	//one cache line per slice
+} thread_range_slice;
+
+struct thread_range_job;
+
+typedef struct
+{
+	struct thread_range_job *job;
+	int slice;
+} thread_range_worker;
+
+typedef struct thread_range_job
+{
+	thread_range_func func;
+	void *argument;
+	int count;
+	int grain;
+
+	thread_range_slice slices[THREAD_POOL_MAX_SLICES];
+	thread_range_worker workers[THREAD_POOL_MAX_SLICES];
+	int slice_count;
+
+	int running;		//workers that have not left the job yet
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+} thread_range_job;
+
+int thread_pool_core_count();
+void thread_pool_make(thread_pool *pool, int thread_count);
+void thread_pool_add_task(thread_pool *pool, thread_task_func func, void *argument);
+void thread_pool_wait(thread_pool *pool);
+void thread_pool_free(thread_pool *pool);
+
+void thread_pool_parallel_for_begin(thread_pool *pool, thread_range_job *job, int count, int grain,
+				    thread_range_func func, void *argument);
+void thread_pool_parallel_for_wait(thread_range_job *job);
+void thread_pool_parallel_for(thread_pool *pool, int count, int grain, thread_range_func func, void *argument);
+
+#endif // __THREAD_POOL_H__